@@ -4,142 +4,1887 @@
 #include <string>
 #include <mutex>
 #include <thread>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+#include <deque>
 #include <iomanip>
+#include <new>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
 using namespace std;
 
-const int MAX_ACCS = 1000;
-const int MAX_PROCS = 100;
+const int MAX_ACCS = 1 << 24;
+const int MAX_PROCS = 1 << 24;
+const int CHUNK_SZ = 4096; // Records per pool chunk
+const int LOCK_STRIPES = 256; // Account locks, shared by account ID
+const int SHARDS_PER_WORKER = 8; // Account shards per worker in execProcs
+const int BURST_UNIT_US = 100;   // CPU work per burst time unit in liveSched
+const size_t EVENT_RING_SZ = 4096; // Pending events before publishers wait
+const int GROUP_COMMIT_RECORDS = 64; // Journal records per sync at most
+const int GROUP_COMMIT_US = 1000;    // Longest a journal record waits for its sync
+const size_t MAX_CUST_ID = 255;      // Longest customer ID, journal records keep its length in a byte
 
-// Account structure
+// Money is kept as an integer count of cents (minor units)
+typedef int64_t Money;
+const double MAX_UNITS = 9e16; // Amounts in units below this fit Money in cents
+
+// Convert an amount entered in units to cents; amounts that are not
+// finite or too large give -1, which every caller rejects
+Money toMoney(double units) {
+    if (!(fabs(units) < MAX_UNITS)) { // Written so nan fails too
+        return -1;
+    }
+    return llround(units * 100);
+}
+
+// Format cents as "units.cents"
+string formatMoney(Money cents) {
+    string sign = cents < 0 ? "-" : "";
+    if (cents < 0) {
+        cents = -cents;
+    }
+    string frac = to_string(cents % 100);
+    return sign + to_string(cents / 100) + (frac.size() < 2 ? ".0" : ".") + frac;
+}
+
+// Chunked pool: grows one chunk at a time so records never move,
+// and the whole pool is freed in one go on destruction
+template <typename T, int CAP>
+class Pool {
+private:
+    T* chunks[(CAP + CHUNK_SZ - 1) / CHUNK_SZ] = {};
+    int chunkCnt = 0;
+    int cnt = 0;
+
+public:
+    Pool() = default;
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
+    ~Pool() {
+        for (int i = 0; i < cnt; i++) {
+            (*this)[i].~T();
+        }
+        for (int c = 0; c < chunkCnt; c++) {
+            ::operator delete(chunks[c]);
+        }
+    }
+
+    T& operator[](int i) { return chunks[i / CHUNK_SZ][i % CHUNK_SZ]; }
+    int size() const { return cnt; }
+    bool full() const { return cnt >= CAP; }
+
+    template <typename... Args>
+    T& add(Args&&... args) {
+        if (cnt % CHUNK_SZ == 0) {
+            chunks[chunkCnt++] = static_cast<T*>(::operator new(sizeof(T) * CHUNK_SZ));
+        }
+        T* slot = new (chunks[cnt / CHUNK_SZ] + cnt % CHUNK_SZ) T{forward<Args>(args)...};
+        cnt++;
+        return *slot;
+    }
+
+    // Allocate chunks for n more records; false if that exceeds CAP
+    bool reserve(int n) {
+        if (n > CAP - cnt) {
+            return false;
+        }
+        while (chunkCnt * CHUNK_SZ < cnt + n) {
+            chunks[chunkCnt++] = static_cast<T*>(::operator new(sizeof(T) * CHUNK_SZ));
+        }
+        return true;
+    }
+
+    // Raw storage for record i of a reserved range; construct it with
+    // placement new, then commit the range
+    T* slot(int i) { return chunks[i / CHUNK_SZ] + i % CHUNK_SZ; }
+
+    // Count n records constructed in reserved slots after the last one
+    void commit(int n) { cnt += n; }
+
+    size_t bytesUsed() const { return sizeof(*this) + (size_t)chunkCnt * CHUNK_SZ * sizeof(T); }
+};
+
+// Fixed set of worker threads that run submitted tasks
+class ThreadPool {
+private:
+    vector<thread> workers;
+    queue<function<void()>> tasks;
+    mutex queueMutex;
+    condition_variable queueCv;
+    bool stopping = false;
+
+    void workerLoop() {
+        while (true) {
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueCv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) {
+                    return;
+                }
+                task = move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+
+public:
+    explicit ThreadPool(unsigned threadCount = thread::hardware_concurrency()) {
+        if (threadCount == 0) {
+            threadCount = 1;
+        }
+        for (unsigned i = 0; i < threadCount; i++) {
+            workers.emplace_back(&ThreadPool::workerLoop, this);
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Finish queued tasks, then stop the workers
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCv.notify_all();
+        for (thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    // Queue a task and get a future for its result
+    template <typename F>
+    auto submit(F&& f) -> future<decltype(f())> {
+        auto task = make_shared<packaged_task<decltype(f())()>>(forward<F>(f));
+        future<decltype(f())> result = task->get_future();
+        {
+            lock_guard<mutex> lock(queueMutex);
+            tasks.emplace([task]() { (*task)(); });
+        }
+        queueCv.notify_one();
+        return result;
+    }
+
+    size_t size() const { return workers.size(); }
+};
+
+// Transaction type and status
+enum class ProcType : uint8_t { Deposit, Withdraw, Transfer };
+enum class ProcStatus : uint8_t { Pending, Completed, Failed };
+
+const char* typeName(ProcType type) {
+    switch (type) {
+    case ProcType::Deposit: return "Deposit";
+    case ProcType::Withdraw: return "Withdraw";
+    case ProcType::Transfer: return "Transfer";
+    }
+    return "Unknown";
+}
+
+const char* statusName(ProcStatus status) {
+    switch (status) {
+    case ProcStatus::Pending: return "Pending";
+    case ProcStatus::Completed: return "Completed";
+    case ProcStatus::Failed: return "Failed";
+    }
+    return "Unknown";
+}
+
+// Interest and fee terms, posted once per whole period. Periods are
+// counted from the Unix epoch, so they line up across restarts.
+struct AccrualTerms {
+    int rateBp = 0;        // Interest per period on a positive balance, in basis points
+    Money fee = 0;         // Fee per period in cents, never taking a balance below zero
+    int periodSeconds = 0; // 0 turns accrual off
+};
+
+// Account structure. Balance, active flag and accrual period are read
+// lock-free under seq (see BankSystem::readAccBalance), so writers store
+// them with the setters inside an AccWrite; only the thread that owns the
+// account (its stripe lock or its execProcs shard) writes them.
 struct Acc {
     int accId;
-    string custId;
-    double balance;
+    uint32_t cust; // Handle into CustIndex
+    Money balance;
     bool active;
-    mutex accMutex;
+    uint32_t accrued; // Accrual period the balance is posted up to, 0 before the first
+    atomic<uint32_t> seq{0}; // Seqlock over balance, active and accrued, odd during a write
 
     // Constructor for initialization
-    Acc(int accId, const string &custId, double balance, bool active)
-        : accId(accId), custId(custId), balance(balance), active(active) {}
+    Acc(int accId, uint32_t cust, Money balance, bool active, uint32_t accrued)
+        : accId(accId), cust(cust), balance(balance), active(active), accrued(accrued) {}
+
+    // Relaxed atomic accesses, plain moves on common targets
+    Money loadBalance() const { return __atomic_load_n(&balance, __ATOMIC_RELAXED); }
+    bool loadActive() const { return __atomic_load_n(&active, __ATOMIC_RELAXED); }
+    uint32_t loadAccrued() const { return __atomic_load_n(&accrued, __ATOMIC_RELAXED); }
+    void setBalance(Money value) { __atomic_store_n(&balance, value, __ATOMIC_RELAXED); }
+    void setActive(bool on) { __atomic_store_n(&active, on, __ATOMIC_RELAXED); }
+    void setAccrued(uint32_t period) { __atomic_store_n(&accrued, period, __ATOMIC_RELAXED); }
+};
+
+// Seqlock write section on one or two accounts: their sequences are odd
+// while it lasts, so lock-free readers retry instead of seeing a
+// half-applied update. b may be null or equal to a.
+class AccWrite {
+private:
+    Acc* a;
+    Acc* b;
+
+    static void bump(Acc* acc, memory_order order) {
+        if (acc) {
+            acc->seq.store(acc->seq.load(memory_order_relaxed) + 1, order);
+        }
+    }
+
+public:
+    explicit AccWrite(Acc* a, Acc* b = nullptr) : a(a), b(b == a ? nullptr : b) {
+        bump(this->a, memory_order_relaxed);
+        bump(this->b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release); // Odd sequences land before the stores
+    }
+
+    ~AccWrite() {
+        bump(a, memory_order_release);
+        bump(b, memory_order_release);
+    }
+
+    AccWrite(const AccWrite&) = delete;
+    AccWrite& operator=(const AccWrite&) = delete;
+};
+
+// Customer record: the customer ID, kept once, and the customer's
+// accounts in creation order
+struct Cust {
+    string custId;
+    vector<int> accIds;
 };
 
-// Process structure
-struct Proc {
-    int tid;
-    int accId;
-    string type;
-    double amount;
-    string status;
-    int burstTime;     // CPU Burst Time
-    int remTime;       // Time left for completion
-    int waitTime;      // Waiting time for each process
-    int turnTime;      // Turnaround time for each process
-    int startTime;     // Time when the process started
-    int endTime;       // Time when the process ended
-};
+// Interned customer IDs with a customer-to-accounts index. Accounts hold
+// a 4-byte handle (index + 1) instead of their own copy of the string.
+// Not locked itself; BankSystem only uses it under bankMutex.
+class CustIndex {
+private:
+    Pool<Cust, MAX_ACCS> custs; // At most one per account
+    unordered_map<string, uint32_t> handles;
+
+public:
+    // Handle for custId, interning it first if it is new
+    uint32_t intern(const string &custId) {
+        auto it = handles.find(custId);
+        if (it != handles.end()) {
+            return it->second;
+        }
+        custs.add(custId, vector<int>());
+        return handles.emplace(custId, (uint32_t)custs.size()).first->second;
+    }
+
+    // Make room for n more customers up front
+    void reserve(size_t n) { handles.reserve(handles.size() + n); }
+
+    // Record an account under a handle from intern
+    void addAcc(uint32_t cust, int accId) { custs[(int)cust - 1].accIds.push_back(accId); }
+
+    const string& name(uint32_t cust) { return custs[(int)cust - 1].custId; }
+
+    // Accounts of custId, or nullptr if there are none
+    const vector<int>* accsOf(const string &custId) {
+        auto it = handles.find(custId);
+        return it == handles.end() ? nullptr : &custs[(int)it->second - 1].accIds;
+    }
+
+    int size() const { return custs.size(); }
+
+    // Bytes reserved, not counting ID strings, account lists and the hash table
+    size_t bytesUsed() const { return custs.bytesUsed(); }
+};
+
+// Striped account lock, padded to a cache line
+struct alignas(64) AccLock {
+    mutex m;
+};
+
+// Process structure
+struct Proc {
+    int tid;
+    int accId;
+    ProcType type;
+    Money amount; // In cents
+    ProcStatus status;
+    int burstTime;     // CPU Burst Time
+    int remTime;       // Time left for completion
+    int waitTime;      // Waiting time for each process
+    int turnTime;      // Turnaround time for each process
+    int startTime;     // Time when the process started
+    int endTime;       // Time when the process ended
+    int toAccId = 0;   // Destination account of a Transfer
+};
+
+// Outcomes reported in events
+enum class AccResult : uint8_t { Created, NegativeBalance, TableFull, CustIdTooLong };
+enum class ProcResult : uint8_t { Completed, AccountNotFound, InsufficientFunds, TableFull, SameAccount, InvalidAmount, BalanceOverflow };
+
+// What an event reports
+enum class EventKind : uint8_t {
+    AccCreated,     // accId
+    AccRejected,    // code = AccResult
+    ProcCreated,    // tid, accId, type, amount
+    ProcRejected,   // code = ProcResult
+    ProcExecuted    // tid, accId, type, code = ProcResult
+};
+
+// Fixed-size binary event record
+struct Event {
+    int64_t timeNs;   // steady_clock time when it was published
+    Money amount;
+    int tid;
+    int accId;
+    EventKind kind;
+    uint8_t code;
+    ProcType type;
+};
+
+// Bounded multi-producer queue of trivially copyable records; producers
+// and the consumer never block each other
+template <typename T, size_t SIZE>
+class RingBuffer {
+private:
+    static_assert((SIZE & (SIZE - 1)) == 0, "RingBuffer size must be a power of two");
+    struct Cell {
+        atomic<size_t> seq;
+        T value;
+    };
+    Cell cells[SIZE];
+    alignas(64) atomic<size_t> tail{0};
+    alignas(64) atomic<size_t> head{0};
+
+public:
+    RingBuffer() {
+        for (size_t i = 0; i < SIZE; i++) {
+            cells[i].seq.store(i, memory_order_relaxed);
+        }
+    }
+
+    // Returns false if the buffer is full
+    bool push(const T& value) {
+        size_t pos = tail.load(memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & (SIZE - 1)];
+            size_t seq = cell.seq.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.seq.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false if the buffer is empty
+    bool pop(T& value) {
+        size_t pos = head.load(memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & (SIZE - 1)];
+            size_t seq = cell.seq.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.seq.store(pos + SIZE, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(memory_order_relaxed);
+            }
+        }
+    }
+};
+
+// Consumer of drained events
+class EventSink {
+public:
+    virtual ~EventSink() = default;
+    virtual void write(const Event& event) = 0;
+    virtual void flush() {}
+};
+
+// Prints events as the familiar console messages
+class ConsoleSink : public EventSink {
+public:
+    void write(const Event& e) override {
+        switch (e.kind) {
+        case EventKind::AccCreated:
+            cout << "Account created successfully! Account ID: " << e.accId << "\n";
+            break;
+        case EventKind::AccRejected:
+            if ((AccResult)e.code == AccResult::NegativeBalance) {
+                cout << "Error: Initial balance cannot be negative.\n";
+            } else if ((AccResult)e.code == AccResult::CustIdTooLong) {
+                cout << "Error: Customer ID is longer than " << MAX_CUST_ID << " characters.\n";
+            } else {
+                cout << "Error: Maximum account limit reached.\n";
+            }
+            break;
+        case EventKind::ProcCreated:
+            cout << "Process created successfully! Transaction ID: " << e.tid << "\n";
+            break;
+        case EventKind::ProcRejected:
+            if ((ProcResult)e.code == ProcResult::AccountNotFound) {
+                cout << "Error: Account not found or inactive.\n";
+            } else if ((ProcResult)e.code == ProcResult::InsufficientFunds) {
+                cout << "Error: Insufficient funds for " << (e.type == ProcType::Transfer ? "transfer" : "withdrawal") << ".\n";
+            } else if ((ProcResult)e.code == ProcResult::SameAccount) {
+                cout << "Error: Cannot transfer to the same account.\n";
+            } else if ((ProcResult)e.code == ProcResult::InvalidAmount) {
+                cout << "Error: Amount must be positive.\n";
+            } else {
+                cout << "Error: Maximum process limit reached.\n";
+            }
+            break;
+        case EventKind::ProcExecuted:
+            if ((ProcResult)e.code == ProcResult::Completed) {
+                cout << "Transaction TID " << e.tid << " (" << typeName(e.type) << ") processed successfully.\n";
+            } else if ((ProcResult)e.code == ProcResult::InsufficientFunds) {
+                cout << "Error: Insufficient funds for transaction ID " << e.tid << "\n";
+            } else if ((ProcResult)e.code == ProcResult::SameAccount) {
+                cout << "Error: Cannot transfer to the same account.\n";
+            } else if ((ProcResult)e.code == ProcResult::BalanceOverflow) {
+                cout << "Error: Transaction ID " << e.tid << " would exceed the largest balance\n";
+            } else {
+                cout << "Error: Account not found for transaction ID " << e.tid << "\n";
+            }
+            break;
+        }
+    }
+
+    void flush() override { cout.flush(); }
+};
+
+// Appends raw Event records to a file
+class BinaryFileSink : public EventSink {
+private:
+    FILE* file;
+
+public:
+    explicit BinaryFileSink(const string& path) : file(fopen(path.c_str(), "ab")) {}
+    ~BinaryFileSink() override {
+        if (file) {
+            fclose(file);
+        }
+    }
+    bool isOpen() const { return file != nullptr; }
+    void write(const Event& e) override {
+        if (file) {
+            fwrite(&e, sizeof(e), 1, file);
+        }
+    }
+    void flush() override {
+        if (file) {
+            fflush(file);
+        }
+    }
+};
+
+// Asynchronous event log: operations publish binary events into a ring
+// buffer and a background thread drains them to the registered sinks
+class EventLog {
+private:
+    RingBuffer<Event, EVENT_RING_SZ> ring;
+    vector<unique_ptr<EventSink>> sinks;
+    mutex sinkMutex; // Held by the drainer while writing, and by addSink
+    atomic<uint64_t> published{0};
+    atomic<uint64_t> drained{0};
+    atomic<bool> stopping{false};
+    thread drainer;
+
+    void drainLoop() {
+        Event event;
+        int idle = 0;
+        while (true) {
+            bool any = false;
+            {
+                lock_guard<mutex> lock(sinkMutex);
+                while (ring.pop(event)) {
+                    for (auto& sink : sinks) {
+                        sink->write(event);
+                    }
+                    drained.fetch_add(1, memory_order_release);
+                    any = true;
+                }
+                if (any) {
+                    for (auto& sink : sinks) {
+                        sink->flush();
+                    }
+                }
+            }
+            if (any) {
+                idle = 0;
+            } else if (stopping.load(memory_order_acquire)) {
+                return;
+            } else if (++idle < 64) {
+                this_thread::yield();
+            } else {
+                this_thread::sleep_for(chrono::microseconds(200));
+            }
+        }
+    }
+
+public:
+    EventLog() : drainer(&EventLog::drainLoop, this) {}
+
+    EventLog(const EventLog&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+
+    // Drain whatever is left, then stop
+    ~EventLog() {
+        flush();
+        stopping.store(true, memory_order_release);
+        drainer.join();
+    }
+
+    void addSink(unique_ptr<EventSink> sink) {
+        lock_guard<mutex> lock(sinkMutex);
+        sinks.push_back(move(sink));
+    }
+
+    // Queue an event; spins only while the ring is full
+    void publish(Event event) {
+        event.timeNs = chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count();
+        published.fetch_add(1, memory_order_relaxed);
+        while (!ring.push(event)) {
+            this_thread::yield();
+        }
+    }
+
+    // Wait until every event published so far has reached the sinks
+    void flush() {
+        uint64_t target = published.load(memory_order_relaxed);
+        while (drained.load(memory_order_acquire) < target) {
+            this_thread::yield();
+        }
+    }
+};
+
+// Latency histogram with HDR-style log-linear buckets: values below
+// 2^HIST_SUB_BITS ns are exact, larger ones fall into 2^HIST_SUB_BITS
+// linear buckets per power of two (about 6% resolution)
+const int HIST_SUB_BITS = 4;
+const int HIST_SUB = 1 << HIST_SUB_BITS;
+const int HIST_MAX_EXP = 40; // ~18 minutes; longer values land in the last bucket
+const int HIST_BUCKETS = (HIST_MAX_EXP - HIST_SUB_BITS + 2) * HIST_SUB;
+
+int histBucket(uint64_t ns) {
+    if (ns < (uint64_t)HIST_SUB) {
+        return (int)ns;
+    }
+    int exp = 63 - __builtin_clzll(ns);
+    if (exp > HIST_MAX_EXP) {
+        return HIST_BUCKETS - 1;
+    }
+    int sub = (int)(ns >> (exp - HIST_SUB_BITS)) & (HIST_SUB - 1);
+    return (exp - HIST_SUB_BITS + 1) * HIST_SUB + sub;
+}
+
+// Highest value that falls into bucket b
+uint64_t histBucketTop(int b) {
+    if (b < HIST_SUB) {
+        return (uint64_t)b;
+    }
+    int exp = b / HIST_SUB - 1 + HIST_SUB_BITS;
+    uint64_t low = (uint64_t)(HIST_SUB + b % HIST_SUB) << (exp - HIST_SUB_BITS);
+    return low + ((uint64_t)1 << (exp - HIST_SUB_BITS)) - 1;
+}
+
+// What the instrumentation measures
+enum class Metric : uint8_t {
+    Create,    // createProc
+    Execute,   // Applying one transaction, including any lock wait
+    LockWait,  // Acquiring account stripe locks
+    COUNT
+};
+
+const char* metricName(Metric metric) {
+    switch (metric) {
+    case Metric::Create: return "create";
+    case Metric::Execute: return "execute";
+    case Metric::LockWait: return "lock_wait";
+    case Metric::COUNT: break;
+    }
+    return "unknown";
+}
+
+const int METRIC_COUNT = (int)Metric::COUNT;
+const int METRIC_SHARDS = 32;      // Threads beyond this share shards
+const unsigned METRIC_SAMPLE = 16; // Time one in this many operations per thread
+
+// Latency histograms and outcome counters. Each thread records into its
+// own cache-line-aligned shard with relaxed loads and stores, so recording
+// takes no lock and threads don't contend; reports merge the shards.
+// Reading the clock costs about as much as a whole deposit, so only one
+// in METRIC_SAMPLE operations is timed; the outcome counters are exact.
+class Metrics {
+private:
+    struct alignas(64) Shard {
+        atomic<uint64_t> hist[METRIC_COUNT][HIST_BUCKETS] = {};
+        atomic<uint64_t> maxNs[METRIC_COUNT] = {};
+        atomic<uint64_t> completed{0};
+        atomic<uint64_t> failed{0};
+    };
+    Shard shards[METRIC_SHARDS];
+    chrono::steady_clock::time_point started = chrono::steady_clock::now();
+
+    static Shard& local(Shard* shards) {
+        static atomic<int> nextSlot{0};
+        thread_local int slot = nextSlot.fetch_add(1, memory_order_relaxed) % METRIC_SHARDS;
+        return shards[slot];
+    }
+
+    // Owner-only increment; threads sharing a shard may lose a few counts
+    static void bump(atomic<uint64_t>& counter) {
+        counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+
+    // Merged view of one metric
+    struct Summary {
+        uint64_t count = 0;
+        uint64_t maxNs = 0;
+        vector<uint64_t> hist = vector<uint64_t>(HIST_BUCKETS, 0);
+
+        uint64_t percentile(double q) const {
+            if (count == 0) {
+                return 0;
+            }
+            uint64_t rank = (uint64_t)ceil(q * count);
+            uint64_t seen = 0;
+            for (int b = 0; b < HIST_BUCKETS; b++) {
+                seen += hist[b];
+                if (seen >= rank) {
+                    return min(histBucketTop(b), maxNs);
+                }
+            }
+            return maxNs;
+        }
+    };
+
+    Summary summarize(Metric metric) const {
+        Summary s;
+        int m = (int)metric;
+        for (const Shard& shard : shards) {
+            for (int b = 0; b < HIST_BUCKETS; b++) {
+                uint64_t n = shard.hist[m][b].load(memory_order_relaxed);
+                s.hist[b] += n;
+                s.count += n;
+            }
+            s.maxNs = max(s.maxNs, shard.maxNs[m].load(memory_order_relaxed));
+        }
+        return s;
+    }
+
+    uint64_t total(atomic<uint64_t> Shard::*counter) const {
+        uint64_t n = 0;
+        for (const Shard& shard : shards) {
+            n += (shard.*counter).load(memory_order_relaxed);
+        }
+        return n;
+    }
+
+    double elapsedSeconds() const {
+        return chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    }
+
+public:
+    typedef chrono::steady_clock::time_point Stamp;
+
+    // Start time of an operation, or a zero Stamp if it isn't sampled
+    static Stamp start() {
+        thread_local unsigned calls = 0;
+        return calls++ % METRIC_SAMPLE == 0 ? chrono::steady_clock::now() : Stamp();
+    }
+
+    // Record the time since since, unless it is a zero Stamp
+    void record(Metric metric, Stamp since) {
+        if (since == Stamp()) {
+            return;
+        }
+        uint64_t ns = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - since).count();
+        Shard& shard = local(shards);
+        int m = (int)metric;
+        bump(shard.hist[m][histBucket(ns)]);
+        if (ns > shard.maxNs[m].load(memory_order_relaxed)) {
+            shard.maxNs[m].store(ns, memory_order_relaxed);
+        }
+    }
+
+    void countOutcome(bool completed) {
+        Shard& shard = local(shards);
+        bump(completed ? shard.completed : shard.failed);
+    }
+
+    // Human-readable table, times in microseconds
+    void print(ostream& out) const {
+        double seconds = elapsedSeconds();
+        out << "\nLatency (us) over " << fixed << setprecision(1) << seconds << " s, 1 in "
+            << METRIC_SAMPLE << " operations sampled:" << endl;
+        out << "Operation\tSamples\tp50\tp99\tp999\tMax" << endl;
+        for (int m = 0; m < METRIC_COUNT; m++) {
+            Summary s = summarize((Metric)m);
+            out << metricName((Metric)m) << (strlen(metricName((Metric)m)) < 8 ? "\t\t" : "\t") << s.count << "\t"
+                << s.percentile(0.50) / 1000.0 << "\t" << s.percentile(0.99) / 1000.0 << "\t"
+                << s.percentile(0.999) / 1000.0 << "\t" << s.maxNs / 1000.0 << endl;
+        }
+        uint64_t completed = total(&Shard::completed);
+        uint64_t failed = total(&Shard::failed);
+        out << "Transactions: " << completed << " completed, " << failed << " failed ("
+            << setprecision(0) << (completed + failed) / seconds << "/sec)" << endl;
+    }
+
+    // Machine-readable CSV, times in nanoseconds
+    bool dump(const string& path) const {
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file) {
+            return false;
+        }
+        double seconds = elapsedSeconds();
+        fprintf(file, "metric,count,per_sec,p50_ns,p99_ns,p999_ns,max_ns\n");
+        for (int m = 0; m < METRIC_COUNT; m++) {
+            Summary s = summarize((Metric)m); // count is samples, per_sec is estimated from them
+            fprintf(file, "%s,%llu,%.1f,%llu,%llu,%llu,%llu\n", metricName((Metric)m), (unsigned long long)s.count,
+                    s.count * (double)METRIC_SAMPLE / seconds, (unsigned long long)s.percentile(0.50), (unsigned long long)s.percentile(0.99),
+                    (unsigned long long)s.percentile(0.999), (unsigned long long)s.maxNs);
+        }
+        uint64_t completed = total(&Shard::completed);
+        uint64_t failed = total(&Shard::failed);
+        fprintf(file, "completed,%llu,%.1f,,,,\n", (unsigned long long)completed, completed / seconds);
+        fprintf(file, "failed,%llu,%.1f,,,,\n", (unsigned long long)failed, failed / seconds);
+        return fclose(file) == 0;
+    }
+};
+
+// Journal record kinds
+enum class JournalOp : uint8_t { OpenAccount = 1, AddProcess, ApplyProcess, PostAccrual = 5 };
+
+// Fixed 32-byte journal record header, followed by nameLen bytes of
+// payload: the customer ID for OpenAccount, a TransferPayload for the
+// AddProcess and ApplyProcess records of a Transfer. For OpenAccount and
+// PostAccrual the tid field carries the account's accrual period.
+struct JournalRecord {
+    uint32_t checksum;  // FNV-1a of the rest of the record and its name bytes
+    JournalOp op;
+    uint8_t type;       // Transaction type
+    uint8_t status;     // Process status after the operation
+    uint8_t nameLen;
+    int32_t tid;
+    int32_t accountId;
+    Money amount;       // Initial balance or transaction amount
+    Money balance;      // Account balance after the operation
+};
+
+// Destination side of a Transfer journal record
+struct TransferPayload {
+    int32_t toAccountId;
+    int32_t pad;
+    Money toBalance; // Destination balance after an ApplyProcess
+};
+
+uint32_t journalChecksum(const JournalRecord& rec, const char* name) {
+    uint32_t hash = 2166136261u;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&rec);
+    for (size_t i = sizeof(rec.checksum); i < sizeof(rec); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    for (int i = 0; i < rec.nameLen; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Append-only write-ahead journal with group commit. Appends only copy
+// into a memory buffer; a flusher thread writes and fdatasyncs the buffer
+// once GROUP_COMMIT_RECORDS are pending or GROUP_COMMIT_US have passed, so
+// many records share one sync.
+class Journal {
+private:
+    int fd = -1;
+    string buffer;           // Records not yet written
+    uint64_t nextLsn = 1;    // LSN handed to the next append
+    uint64_t bufferedLsn = 0;
+    uint64_t durableLsn = 0; // Everything up to here is on disk
+    bool failed = false;     // A write or sync failed; durableLsn never moves again
+    bool stopping = false;
+    mutex journalMutex;
+    condition_variable flushCv;   // Wakes the flusher
+    condition_variable durableCv; // Wakes waitDurable callers
+    thread flusher;
+
+    void flushLoop() {
+        string writing;
+        unique_lock<mutex> lock(journalMutex);
+        while (true) {
+            flushCv.wait_for(lock, chrono::microseconds(GROUP_COMMIT_US), [this]() {
+                return stopping || nextLsn - 1 - durableLsn >= (uint64_t)GROUP_COMMIT_RECORDS;
+            });
+            if (buffer.empty()) {
+                if (stopping) {
+                    return;
+                }
+                continue;
+            }
+            writing.swap(buffer);
+            uint64_t batchLsn = bufferedLsn;
+            if (failed) {
+                writing.clear(); // Nothing after the failed batch may reach the file
+                continue;
+            }
+            lock.unlock();
+            size_t done = 0;
+            bool ok = true;
+            while (ok && done < writing.size()) {
+                ssize_t n = ::write(fd, writing.data() + done, writing.size() - done);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                ok = n > 0;
+                done += ok ? (size_t)n : 0;
+            }
+            ok = ok && fdatasync(fd) == 0;
+            if (!ok) {
+                cerr << "Error: Journal write failed: " << strerror(errno) << endl;
+            }
+            writing.clear();
+            lock.lock();
+            if (ok) {
+                durableLsn = batchLsn;
+            } else {
+                failed = true; // The batch is never acknowledged
+            }
+            durableCv.notify_all();
+        }
+    }
+
+public:
+    Journal() = default;
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    ~Journal() {
+        if (fd < 0) {
+            return;
+        }
+        {
+            lock_guard<mutex> lock(journalMutex);
+            stopping = true;
+        }
+        flushCv.notify_one();
+        flusher.join();
+        ::close(fd);
+    }
+
+    // Open for appending; call after replay
+    bool open(const string& path) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        flusher = thread(&Journal::flushLoop, this);
+        return true;
+    }
+
+    bool isOpen() const { return fd >= 0; }
+
+    uint64_t lastLsn() {
+        lock_guard<mutex> lock(journalMutex);
+        return bufferedLsn;
+    }
+
+    // Buffer a record; returns its LSN for waitDurable
+    uint64_t append(JournalRecord rec, const string& name = string()) {
+        rec.nameLen = (uint8_t)min(name.size(), (size_t)255);
+        rec.checksum = journalChecksum(rec, name.data());
+        lock_guard<mutex> lock(journalMutex);
+        buffer.append(reinterpret_cast<const char*>(&rec), sizeof(rec));
+        buffer.append(name.data(), rec.nameLen);
+        bufferedLsn = nextLsn++;
+        if (bufferedLsn - durableLsn >= (uint64_t)GROUP_COMMIT_RECORDS) {
+            flushCv.notify_one();
+        }
+        return bufferedLsn;
+    }
+
+    // Block until the record with this LSN has been synced; false if it
+    // never will be because a write or sync failed
+    bool waitDurable(uint64_t lsn) {
+        unique_lock<mutex> lock(journalMutex);
+        durableCv.wait(lock, [this, lsn]() { return durableLsn >= lsn || failed; });
+        return durableLsn >= lsn;
+    }
+
+    // Apply every intact record in path in order and return how many there
+    // were. A torn tail from a crash is cut off so new appends follow the
+    // last good record.
+    static long replay(const string& path, const function<void(const JournalRecord&, const string&)>& apply) {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) {
+            return 0;
+        }
+        JournalRecord rec;
+        char name[256];
+        long count = 0;
+        long good = 0;
+        while (fread(&rec, sizeof(rec), 1, file) == 1) {
+            if (rec.nameLen > 0 && fread(name, rec.nameLen, 1, file) != 1) {
+                break;
+            }
+            if (rec.checksum != journalChecksum(rec, name)) {
+                break;
+            }
+            apply(rec, string(name, rec.nameLen));
+            good = ftell(file);
+            count++;
+        }
+        fseek(file, 0, SEEK_END);
+        bool torn = ftell(file) > good;
+        fclose(file);
+        if (torn && truncate(path.c_str(), good) != 0) {
+            cerr << "Error: Cannot trim journal " << path << endl;
+        }
+        return count;
+    }
+};
+
+// Pending transactions of one account shard, in TID order
+typedef vector<Proc*> ProcShard;
+
+// Per-worker queue of shards; the owner pops the front, thieves take the back
+struct ShardQueue {
+    mutex m;
+    deque<ProcShard*> shards;
+};
+
+// CPU scheduling policy for runSched. The runner hands it each process
+// with time left, picks what runs next and for how long, and hands back
+// whatever is still unfinished after its slice.
+class Scheduler {
+public:
+    virtual ~Scheduler() = default;
+    virtual string describe() const = 0;
+    // Process i (procs[i], remTime units left) is ready to run
+    virtual void ready(int i, const Proc& proc, int remTime) = 0;
+    // Next process and the longest slice it may run; false when none left
+    virtual bool pick(int& i, int& timeSlice) = 0;
+};
+
+// Round Robin: FIFO ready queue, fixed quantum
+class RoundRobinScheduler : public Scheduler {
+private:
+    int quantum;
+    queue<int> readyQ;
+
+public:
+    explicit RoundRobinScheduler(int quantum) : quantum(quantum) {}
+    string describe() const override {
+        return "Round Robin Scheduling with Time Quantum: " + to_string(quantum) + " units";
+    }
+    void ready(int i, const Proc&, int) override { readyQ.push(i); }
+    bool pick(int& i, int& timeSlice) override {
+        if (readyQ.empty()) {
+            return false;
+        }
+        i = readyQ.front();
+        readyQ.pop();
+        timeSlice = quantum;
+        return true;
+    }
+};
+
+// Shortest Remaining Time First. Every process is ready at time 0, so
+// nothing arrives to preempt the running one and it runs to completion
+// (the same schedule as SJF).
+class SrtfScheduler : public Scheduler {
+private:
+    priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> readyQ; // (remTime, i)
+
+public:
+    string describe() const override { return "Shortest Remaining Time First (SJF/SRTF) Scheduling"; }
+    void ready(int i, const Proc&, int remTime) override { readyQ.push({remTime, i}); }
+    bool pick(int& i, int& timeSlice) override {
+        if (readyQ.empty()) {
+            return false;
+        }
+        timeSlice = readyQ.top().first;
+        i = readyQ.top().second;
+        readyQ.pop();
+        return true;
+    }
+};
+
+// Non-preemptive priority: money leaving an account goes first, largest
+// amount first; deposits follow in TID order
+class PriorityScheduler : public Scheduler {
+private:
+    struct Entry {
+        Money outflow;
+        int i;
+        int remTime;
+        bool operator<(const Entry& o) const { return outflow != o.outflow ? outflow < o.outflow : i > o.i; }
+    };
+    priority_queue<Entry> readyQ;
+
+public:
+    string describe() const override { return "Priority Scheduling (largest withdrawals first)"; }
+    void ready(int i, const Proc& proc, int remTime) override {
+        readyQ.push({proc.type == ProcType::Deposit ? 0 : proc.amount, i, remTime});
+    }
+    bool pick(int& i, int& timeSlice) override {
+        if (readyQ.empty()) {
+            return false;
+        }
+        i = readyQ.top().i;
+        timeSlice = readyQ.top().remTime;
+        readyQ.pop();
+        return true;
+    }
+};
+
+// Multi-level feedback queue: MLFQ_LEVELS FIFO levels whose quantum
+// doubles per level. New processes start at the top; one that uses its
+// whole slice without finishing drops a level.
+class MlfqScheduler : public Scheduler {
+private:
+    static const int MLFQ_LEVELS = 3;
+    int baseQuantum;
+    queue<int> levels[MLFQ_LEVELS];
+    vector<int> levelOf; // Level of each process seen so far, -1 if new
+
+public:
+    explicit MlfqScheduler(int baseQuantum) : baseQuantum(baseQuantum) {}
+    string describe() const override {
+        return "Multi-Level Feedback Queue Scheduling with Base Quantum: " + to_string(baseQuantum) + " units";
+    }
+    void ready(int i, const Proc&, int) override {
+        if ((int)levelOf.size() <= i) {
+            levelOf.resize(i + 1, -1);
+        }
+        levelOf[i] = min(levelOf[i] + 1, MLFQ_LEVELS - 1);
+        levels[levelOf[i]].push(i);
+    }
+    bool pick(int& i, int& timeSlice) override {
+        for (int level = 0; level < MLFQ_LEVELS; level++) {
+            if (!levels[level].empty()) {
+                i = levels[level].front();
+                levels[level].pop();
+                timeSlice = baseQuantum << level;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// Scheduler for a menu policy number; null for an unknown policy or a
+// quantum that isn't positive
+unique_ptr<Scheduler> makeScheduler(int policy, int timeQuantum) {
+    switch (policy) {
+    case 1: return timeQuantum > 0 ? unique_ptr<Scheduler>(new RoundRobinScheduler(timeQuantum)) : nullptr;
+    case 2: return unique_ptr<Scheduler>(new SrtfScheduler());
+    case 3: return unique_ptr<Scheduler>(new PriorityScheduler());
+    case 4: return timeQuantum > 0 ? unique_ptr<Scheduler>(new MlfqScheduler(timeQuantum)) : nullptr;
+    }
+    return nullptr;
+}
+
+// Account parsed from a bulk load file
+struct AccRow {
+    string custId;
+    Money balance;
+};
+
+// Parse "customerID,balance" lines of data[begin, end) into rows; lines
+// that don't parse, have a customer ID longer than MAX_CUST_ID or have a
+// negative, non-finite or too large balance are counted in skipped
+void parseAccRows(const string& data, size_t begin, size_t end, vector<AccRow>& rows, long& skipped) {
+    while (begin < end) {
+        size_t lineEnd = data.find('\n', begin);
+        if (lineEnd == string::npos || lineEnd > end) {
+            lineEnd = end;
+        }
+        size_t len = lineEnd - begin;
+        if (len > 0 && data[begin + len - 1] == '\r') {
+            len--;
+        }
+        if (len > 0) {
+            string line = data.substr(begin, len);
+            size_t comma = line.find(',');
+            char* parsedEnd = nullptr;
+            double units = comma == string::npos ? 0 : strtod(line.c_str() + comma + 1, &parsedEnd);
+            if (comma == 0 || comma == string::npos || comma > MAX_CUST_ID || parsedEnd == line.c_str() + comma + 1 ||
+                *parsedEnd != '\0' || !(units >= 0 && units < MAX_UNITS)) { // Written so nan fails too
+                skipped++;
+            } else {
+                rows.push_back({line.substr(0, comma), toMoney(units)});
+            }
+        }
+        begin = lineEnd + 1;
+    }
+}
+
+// Banking system
+class BankSystem {
+private:
+    Pool<Acc, MAX_ACCS> accs;
+    Pool<Proc, MAX_PROCS> procs;
+    atomic<int> nextAccId{1}; // Stored after the account, so lock-free readers see it whole
+    int nextTid = 1;
+    Pool<Acc*, MAX_ACCS> accById; // Account ID - 1 -> account (IDs are dense)
+    CustIndex custs;
+    mutex bankMutex;
+    AccLock accLocks[LOCK_STRIPES];
+    Metrics metrics;
+    EventLog eventLog; // Outlives the pool so worker events still drain
+    Journal journal;   // Optional write-ahead journal, see openJournal
+    AccrualTerms terms; // See setAccrual
+    mutex shardMutex;   // Held while execProcs shards own accounts without their stripe locks
+    uint32_t sweptPeriod = 0; // Last period sweepAccrual ran in, under shardMutex
+    thread sweeper;
+    mutex sweepMutex;
+    condition_variable sweepCv;
+    bool stopSweeping = false;
+    ThreadPool pool; // Declared last so workers stop before the tables go away
+
+    mutex& accMutex(int accId) {
+        return accLocks[accId % LOCK_STRIPES].m;
+    }
+
+    void publish(EventKind kind, uint8_t code, int tid, int accId, ProcType type, Money amount) {
+        Event event{};
+        event.kind = kind;
+        event.code = code;
+        event.tid = tid;
+        event.accId = accId;
+        event.type = type;
+        event.amount = amount;
+        eventLog.publish(event);
+    }
+
+    void rejectAcc(AccResult why) {
+        publish(EventKind::AccRejected, (uint8_t)why, 0, 0, ProcType::Deposit, 0);
+    }
+
+    void rejectProc(ProcResult why, int accId, ProcType type, Money amount) {
+        publish(EventKind::ProcRejected, (uint8_t)why, 0, accId, type, amount);
+    }
+
+    void journalProc(JournalOp op, const Proc& proc, Money balance, Money toBalance = 0) {
+        JournalRecord rec{};
+        rec.op = op;
+        rec.type = (uint8_t)proc.type;
+        rec.status = (uint8_t)proc.status;
+        rec.tid = proc.tid;
+        rec.accountId = proc.accId;
+        rec.amount = proc.amount;
+        rec.balance = balance;
+        if (proc.type != ProcType::Transfer) {
+            journal.append(rec);
+            return;
+        }
+        TransferPayload payload{proc.toAccId, 0, toBalance};
+        journal.append(rec, string(reinterpret_cast<const char*>(&payload), sizeof(payload)));
+    }
+
+    // Lock the stripes of both accounts of a transaction in array order,
+    // so transfers in opposite directions can't deadlock; a stripe shared
+    // by both accounts is taken once
+    void lockAccs(const Proc& proc, unique_lock<mutex>& first, unique_lock<mutex>& second) {
+        Metrics::Stamp start = Metrics::start();
+        mutex* a = &accMutex(proc.accId);
+        mutex* b = proc.type == ProcType::Transfer ? &accMutex(proc.toAccId) : a;
+        if (b < a) {
+            swap(a, b);
+        }
+        first = unique_lock<mutex>(*a);
+        if (b != a) {
+            second = unique_lock<mutex>(*b);
+        }
+        metrics.record(Metric::LockWait, start);
+    }
+
+    // Rebuild state from one journal record; IDs were handed out in order
+    // under bankMutex, so records arrive in ID order
+    void replayRecord(const JournalRecord& rec, const string& name) {
+        switch (rec.op) {
+        case JournalOp::OpenAccount:
+            if (rec.accountId == nextAccId && !accs.full()) {
+                addAcc(name, rec.amount, (uint32_t)rec.tid);
+            }
+            break;
+        case JournalOp::AddProcess:
+            if (rec.tid == nextTid && !procs.full()) {
+                int burst = (int)rec.balance;
+                TransferPayload payload{};
+                if (name.size() == sizeof(payload)) {
+                    memcpy(&payload, name.data(), sizeof(payload));
+                }
+                procs.add(Proc{nextTid++, rec.accountId, (ProcType)rec.type, rec.amount, ProcStatus::Pending,
+                               burst, burst, 0, 0, -1, -1, payload.toAccountId});
+            }
+            break;
+        case JournalOp::ApplyProcess: {
+            if (rec.tid >= 1 && rec.tid < nextTid) {
+                Proc& proc = procs[rec.tid - 1];
+                proc.status = (ProcStatus)rec.status;
+                proc.remTime = 0; // Already ran, the scheduler must not run it again
+            }
+            if ((ProcStatus)rec.status != ProcStatus::Completed) {
+                break;
+            }
+            Acc* acc = getAccById(rec.accountId);
+            if (acc) {
+                acc->setBalance(rec.balance);
+            }
+            TransferPayload payload;
+            if (name.size() == sizeof(payload)) {
+                memcpy(&payload, name.data(), sizeof(payload));
+                if (Acc* to = getAccById(payload.toAccountId)) {
+                    to->setBalance(payload.toBalance);
+                }
+            }
+            break;
+        }
+        case JournalOp::PostAccrual: {
+            Acc* acc = getAccById(rec.accountId);
+            if (acc) {
+                acc->setBalance(rec.balance);
+                acc->setAccrued((uint32_t)rec.tid);
+            }
+            break;
+        }
+        }
+    }
+
+    // Wait until everything journaled so far is on disk. If the journal
+    // can't be written the program stops: the changes are applied in
+    // memory, and the caller must never report them done.
+    void syncJournal() {
+        if (journal.isOpen() && !journal.waitDurable(journal.lastLsn())) {
+            cerr << "Error: Journal is not durable, stopping." << endl;
+            abort();
+        }
+    }
 
-// Banking system
-class BankSystem {
-private:
-    Acc* accs[MAX_ACCS];
-    Proc procs[MAX_PROCS];
-    int accCnt = 0;
-    int procCnt = 0;
-    int nextAccId = 1;
-    int nextTid = 1;
-    mutex bankMutex;
+    // Add the next account under bankMutex, posted up to accrual period
+    // accrued; returns its ID
+    int addAcc(const string &custId, Money balance, uint32_t accrued) {
+        int accId = nextAccId.load(memory_order_relaxed);
+        uint32_t cust = custs.intern(custId);
+        accById.add(&accs.add(accId, cust, balance, true, accrued));
+        custs.addAcc(cust, accId);
+        nextAccId.store(accId + 1, memory_order_release);
+        return accId;
+    }
 
     Acc* getAccById(int accId) {
-        for (int i = 0; i < accCnt; i++) {
-            if (accs[i]->accId == accId && accs[i]->active) {
-                return accs[i];
-            }
+        if (accId < 1 || accId >= nextAccId) {
+            return nullptr;
         }
-        return nullptr;
+        Acc* acc = accById[accId - 1];
+        return acc->loadActive() ? acc : nullptr;
+    }
+
+    // Accrual period of the current time, 0 while accrual is off
+    uint32_t currentPeriod() const {
+        return terms.periodSeconds > 0 ? (uint32_t)(time(nullptr) / terms.periodSeconds) : 0;
+    }
+
+    // Balance once periods from to to - 1 are posted to it: each adds
+    // the interest, then takes the fee, stopping at zero. Closed form, so
+    // a dormant account costs no more to read than any other; cents are
+    // rounded down once at the end. An account stamped 0 has not started
+    // accruing.
+    Money accrue(Money balance, uint32_t from, uint32_t to) const {
+        if (from == 0 || to <= from || balance <= 0) {
+            return balance;
+        }
+        long double periods = to - from;
+        long double value;
+        if (terms.rateBp == 0) {
+            value = balance - terms.fee * periods;
+        } else if ((long double)balance * terms.rateBp == (long double)terms.fee * 10000) {
+            return balance; // Interest and fee cancel out
+        } else {
+            // Distance from the balance where they cancel grows by the rate
+            long double rate = terms.rateBp / 10000.0L;
+            long double level = terms.fee / rate;
+            value = level + (balance - level) * powl(1 + rate, periods);
+        }
+        if (value <= 0) {
+            return 0; // Every period shrank it, so it stopped at zero
+        }
+        return value >= (long double)INT64_MAX ? INT64_MAX : (Money)floorl(value);
+    }
+
+    // Post the periods acc has missed up to period now, so its balance is
+    // current before a write; the caller must own the account. Returns
+    // false if there was nothing to post.
+    bool postAccrual(Acc* acc, uint32_t now) {
+        if (acc->accrued >= now) {
+            return false;
+        }
+        Money balance = accrue(acc->balance, acc->accrued, now);
+        Money posted = balance - acc->balance;
+        {
+            AccWrite write(acc);
+            acc->setBalance(balance);
+            acc->setAccrued(now);
+        }
+        if (journal.isOpen()) {
+            JournalRecord rec{};
+            rec.op = JournalOp::PostAccrual;
+            rec.tid = (int32_t)now;
+            rec.accountId = acc->accId;
+            rec.amount = posted;
+            rec.balance = balance;
+            journal.append(rec);
+        }
+        return true;
     }
 
 public:
-    // Create an account
-    int createAcc(const string &custId, double initBalance) {
-        lock_guard<mutex> lock(bankMutex);
-        if (accCnt >= MAX_ACCS) {
-            cout << "Error: Maximum account limit reached." << endl;
-            return -1;
+    // Events go to the console unless consoleEvents is false
+    explicit BankSystem(bool consoleEvents = true) {
+        if (consoleEvents) {
+            eventLog.addSink(unique_ptr<EventSink>(new ConsoleSink()));
         }
-        if (initBalance < 0) {
-            cout << "Error: Initial balance cannot be negative." << endl;
-            return -1;
+    }
+
+    ~BankSystem() {
+        if (sweeper.joinable()) {
+            {
+                lock_guard<mutex> lock(sweepMutex);
+                stopSweeping = true;
+            }
+            sweepCv.notify_one();
+            sweeper.join();
+        }
+    }
+
+    EventLog& events() { return eventLog; }
+    const Metrics& stats() const { return metrics; }
+
+    // Post interest and fees under terms. Nothing is posted per period:
+    // an account catches up on the periods it missed the next time a
+    // transaction touches it, and balance reads include what is pending.
+    // Call before any transaction runs.
+    void setAccrual(const AccrualTerms& accrual) { terms = accrual; }
+
+    // Recover accounts and processes from the journal at path, then
+    // journal every change to it. Call before any other operation.
+    bool openJournal(const string &path) {
+        long count = Journal::replay(path, [this](const JournalRecord& rec, const string& name) {
+            replayRecord(rec, name);
+        });
+        if (count > 0) {
+            cout << "Recovered " << count << " journal records from " << path << endl;
+        }
+        return journal.open(path);
+    }
+
+    // Create an account
+    int createAcc(const string &custId, Money initBalance) {
+        int accId;
+        {
+            lock_guard<mutex> lock(bankMutex);
+            if (accs.full()) {
+                rejectAcc(AccResult::TableFull);
+                return -1;
+            }
+            if (initBalance < 0) {
+                rejectAcc(AccResult::NegativeBalance);
+                return -1;
+            }
+            if (custId.size() > MAX_CUST_ID) {
+                rejectAcc(AccResult::CustIdTooLong);
+                return -1;
+            }
+            uint32_t period = currentPeriod();
+            accId = addAcc(custId, initBalance, period);
+            if (journal.isOpen()) {
+                JournalRecord rec{};
+                rec.op = JournalOp::OpenAccount;
+                rec.tid = (int32_t)period;
+                rec.accountId = accId;
+                rec.amount = initBalance;
+                rec.balance = initBalance;
+                journal.append(rec, custId);
+            }
         }
-        int accId = nextAccId++;
-        accs[accCnt] = new Acc(accId, custId, initBalance, true);
-        accCnt++;
-        cout << "Account created successfully! Account ID: " << accId << endl;
+        syncJournal(); // Outside bankMutex so other callers keep going
+        publish(EventKind::AccCreated, (uint8_t)AccResult::Created, 0, accId, ProcType::Deposit, initBalance);
         return accId;
     }
 
-    // Create a transaction process
-    int createProc(int accId, const string &type, double amount, int burstTime = 5) {
-        lock_guard<mutex> lock(bankMutex);
-        Acc* acc = getAccById(accId);
-        if (!acc) {
-            cout << "Error: Account not found or inactive." << endl;
+    // Load accounts from a CSV file of "customerID,balance" lines. Lines are
+    // parsed in parallel, the accounts get one contiguous ID range and are
+    // built in place, and they all become visible at once at the end.
+    // Returns how many were loaded, or -1 if the file can't be read or the
+    // table has no room for them.
+    long bulkLoadAccs(const string &path) {
+        auto start = chrono::steady_clock::now();
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) {
+            cout << "Error: Cannot open " << path << endl;
             return -1;
         }
-        if (type == "Withdraw" && acc->balance < amount) {
-            cout << "Error: Insufficient funds for withdrawal." << endl;
-            return -1;
+        string data;
+        char buf[1 << 16];
+        size_t got;
+        while ((got = fread(buf, 1, sizeof(buf), file)) > 0) {
+            data.append(buf, got);
         }
-        if (procCnt >= MAX_PROCS) {
-            cout << "Error: Maximum process limit reached." << endl;
-            return -1;
+        fclose(file);
+
+        // Cut the file at line ends into a few pieces per worker
+        int pieceCnt = (int)pool.size() * 4;
+        vector<size_t> bounds(1, 0);
+        for (int p = 1; p < pieceCnt; p++) {
+            size_t at = data.find('\n', max(bounds.back(), data.size() / pieceCnt * p));
+            bounds.push_back(at == string::npos ? data.size() : at + 1);
+        }
+        bounds.push_back(data.size());
+        pieceCnt = (int)bounds.size() - 1;
+
+        vector<vector<AccRow>> rows(pieceCnt);
+        vector<long> skipped(pieceCnt, 0);
+        vector<future<void>> done;
+        for (int p = 0; p < pieceCnt; p++) {
+            done.push_back(pool.submit([&, p]() { parseAccRows(data, bounds[p], bounds[p + 1], rows[p], skipped[p]); }));
+        }
+        for (future<void>& f : done) {
+            f.wait();
+        }
+
+        // Piece p gets the IDs after those of the pieces before it
+        vector<long> firstRow(pieceCnt + 1, 0);
+        long skippedCnt = 0;
+        for (int p = 0; p < pieceCnt; p++) {
+            firstRow[p + 1] = firstRow[p] + (long)rows[p].size();
+            skippedCnt += skipped[p];
+        }
+        long total = firstRow[pieceCnt];
+
+        int firstId;
+        {
+            lock_guard<mutex> lock(bankMutex);
+            if (total > MAX_ACCS || !accs.reserve((int)total) || !accById.reserve((int)total)) {
+                cout << "Error: Not enough room for " << total << " accounts" << endl;
+                return -1;
+            }
+            int accBase = accs.size();
+            firstId = nextAccId; // accById[i] is account ID i + 1
+            // Interning shares one table, so it runs here; the accounts
+            // are still built in parallel
+            vector<vector<uint32_t>> handles(pieceCnt);
+            custs.reserve((size_t)total);
+            for (int p = 0; p < pieceCnt; p++) {
+                handles[p].resize(rows[p].size());
+                for (size_t i = 0; i < rows[p].size(); i++) {
+                    handles[p][i] = custs.intern(rows[p][i].custId);
+                    custs.addAcc(handles[p][i], firstId + (int)(firstRow[p] + (long)i));
+                }
+            }
+            done.clear();
+            uint32_t period = currentPeriod();
+            for (int p = 0; p < pieceCnt; p++) {
+                done.push_back(pool.submit([&, p]() {
+                    for (size_t i = 0; i < rows[p].size(); i++) {
+                        int row = (int)(firstRow[p] + (long)i);
+                        AccRow& in = rows[p][i];
+                        Acc* acc = new (accs.slot(accBase + row)) Acc(firstId + row, handles[p][i], in.balance, true, period);
+                        new (accById.slot(firstId - 1 + row)) Acc*(acc);
+                    }
+                }));
+            }
+            for (future<void>& f : done) {
+                f.wait();
+            }
+            accs.commit((int)total);
+            accById.commit((int)total);
+            if (journal.isOpen()) {
+                for (int i = 0; i < (int)total; i++) {
+                    Acc& acc = accs[accBase + i];
+                    JournalRecord rec{};
+                    rec.op = JournalOp::OpenAccount;
+                    rec.tid = (int32_t)period;
+                    rec.accountId = acc.accId;
+                    rec.amount = acc.balance;
+                    rec.balance = acc.balance;
+                    journal.append(rec, custs.name(acc.cust));
+                }
+            }
+            nextAccId += (int)total; // Publishes the whole range at once
         }
-        int tid = nextTid++;
-        procs[procCnt] = {tid, accId, type, amount, "Pending", burstTime, burstTime, 0, 0, -1, -1};
-        procCnt++;
-        cout << "Process created successfully! Transaction ID: " << tid << endl;
+        syncJournal();
+
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "Loaded " << total << " accounts";
+        if (total > 0) {
+            cout << " (IDs " << firstId << " to " << firstId + total - 1 << ")";
+        }
+        cout << " in " << fixed << setprecision(3) << seconds << " s, "
+             << setprecision(0) << (seconds > 0 ? total / seconds : 0) << " accounts/second" << endl;
+        if (skippedCnt > 0) {
+            cout << "Skipped " << skippedCnt << " malformed lines" << endl;
+        }
+        return total;
+    }
+
+    // Create a transaction process; toAccId is the destination of a Transfer
+    int createProc(int accId, ProcType type, Money amount, int burstTime = 5, int toAccId = 0) {
+        Metrics::Stamp start = Metrics::start();
+        int tid;
+        {
+            lock_guard<mutex> lock(bankMutex);
+            if (amount <= 0) {
+                rejectProc(ProcResult::InvalidAmount, accId, type, amount);
+                return -1;
+            }
+            Acc* acc = getAccById(accId);
+            if (!acc || (type == ProcType::Transfer && !getAccById(toAccId))) {
+                rejectProc(ProcResult::AccountNotFound, accId, type, amount);
+                return -1;
+            }
+            if (type == ProcType::Transfer && toAccId == accId) {
+                rejectProc(ProcResult::SameAccount, accId, type, amount);
+                return -1;
+            }
+            Money balance = 0;
+            readAccBalance(accId, balance); // With pending interest and fees
+            if (type != ProcType::Deposit && balance < amount) {
+                rejectProc(ProcResult::InsufficientFunds, accId, type, amount);
+                return -1;
+            }
+            if (procs.full()) {
+                rejectProc(ProcResult::TableFull, accId, type, amount);
+                return -1;
+            }
+            tid = nextTid++;
+            Proc& proc = procs.add(Proc{tid, accId, type, amount, ProcStatus::Pending, burstTime, burstTime, 0, 0, -1, -1,
+                                        type == ProcType::Transfer ? toAccId : 0});
+            if (journal.isOpen()) {
+                journalProc(JournalOp::AddProcess, proc, burstTime); // Balance field carries the burst time
+            }
+        }
+        syncJournal();
+        publish(EventKind::ProcCreated, (uint8_t)ProcResult::Completed, tid, accId, type, amount);
+        metrics.record(Metric::Create, start);
         return tid;
     }
 
-    // Check account balance
-    void checkAccBalance(int accId) {
+    // Create a transfer of amount from one account to another, run as a
+    // single process
+    int createTransfer(int fromAccId, int toAccId, Money amount, int burstTime = 5) {
+        return createProc(fromAccId, ProcType::Transfer, amount, burstTime, toAccId);
+    }
+
+    // Display every account of a customer and their total balance
+    void printCustAccs(const string &custId) {
         lock_guard<mutex> lock(bankMutex);
-        Acc* acc = getAccById(accId);
-        if (!acc) {
+        const vector<int>* accIds = custs.accsOf(custId);
+        if (!accIds) {
+            cout << "Error: No accounts for customer " << custId << "." << endl;
+            return;
+        }
+        Money total = 0;
+        cout << "Accounts of " << custId << ":\n";
+        cout << "AccID\tBalance\t\tStatus\n";
+        for (int accId : *accIds) {
+            Money balance = 0;
+            bool active = readAccBalance(accId, balance);
+            if (active) {
+                total += balance;
+            }
+            cout << accId << "\t" << formatMoney(balance) << "\t\t" << (active ? "Active" : "Closed") << "\n";
+        }
+        cout << "Total Balance: $" << formatMoney(total) << endl;
+    }
+
+    // Read an account's balance without bankMutex or its stripe lock, so
+    // balance reads never stall writers or each other. The read is
+    // retried while a writer is inside the account's seqlock or has
+    // passed through it meanwhile. Interest and fees not posted yet are
+    // included, though only a write posts them. Returns false for unknown
+    // and closed accounts; a closed account's balance is still filled in.
+    bool readAccBalance(int accId, Money& balance) {
+        if (accId < 1 || accId >= nextAccId.load(memory_order_acquire)) {
+            return false;
+        }
+        const Acc* acc = accById[accId - 1];
+        uint32_t now = currentPeriod();
+        while (true) {
+            uint32_t before = acc->seq.load(memory_order_acquire);
+            if (before & 1) {
+                this_thread::yield();
+                continue;
+            }
+            Money value = acc->loadBalance();
+            bool active = acc->loadActive();
+            uint32_t accrued = acc->loadAccrued();
+            atomic_thread_fence(memory_order_acquire); // Loads above finish before the recheck
+            if (acc->seq.load(memory_order_relaxed) == before) {
+                balance = active ? accrue(value, accrued, now) : value;
+                return active;
+            }
+        }
+    }
+
+    // Check account balance, lock-free
+    void checkAccBalance(int accId) {
+        Money balance;
+        if (!readAccBalance(accId, balance)) {
             cout << "Error: Account not found or inactive." << endl;
             return;
         }
-        cout << "Account ID: " << accId << "\nCustomer ID: " << acc->custId
-             << "\nBalance: $" << fixed << setprecision(2) << acc->balance << endl;
+        cout << "Account ID: " << accId << "\nCustomer ID: " << custs.name(accById[accId - 1]->cust)
+             << "\nBalance: $" << formatMoney(balance) << endl;
     }
 
-    // Execute transactions in separate threads
+    // Execute pending transactions on the worker pool. Transactions are
+    // sharded by account ID and each shard runs start to finish on one
+    // worker, so an account is only ever touched by one thread and needs
+    // no lock. Idle workers steal whole shards from the others.
     void execProcs() {
-        thread procThreads[MAX_PROCS];
-        for (int i = 0; i < procCnt; i++) {
-            procThreads[i] = thread(&BankSystem::processProc, this, ref(procs[i]));
+        lock_guard<mutex> owner(shardMutex);
+        int workers = (int)pool.size();
+        int shardCnt = workers * SHARDS_PER_WORKER;
+        vector<ProcShard> shards(shardCnt);
+        vector<Proc*> crossShard; // Transfers between accounts of two shards
+        for (int i = 0; i < procs.size(); i++) {
+            Proc& proc = procs[i];
+            if (proc.status != ProcStatus::Pending) {
+                continue;
+            }
+            if (proc.type == ProcType::Transfer && proc.toAccId % shardCnt != proc.accId % shardCnt) {
+                crossShard.push_back(&proc);
+            } else {
+                shards[proc.accId % shardCnt].push_back(&proc);
+            }
+        }
+
+        vector<ShardQueue> queues(workers);
+        for (int s = 0; s < shardCnt; s++) {
+            if (!shards[s].empty()) {
+                queues[s % workers].shards.push_back(&shards[s]);
+            }
+        }
+
+        vector<future<void>> done;
+        for (int w = 0; w < workers; w++) {
+            done.push_back(pool.submit([this, &queues, w]() { runShards(queues, w); }));
+        }
+        for (future<void>& f : done) {
+            f.wait();
+        }
+
+        // Cross-shard transfers run once the shards are done, spread over
+        // the workers and taking both account locks
+        done.clear();
+        size_t step = (crossShard.size() + workers - 1) / workers;
+        for (size_t begin = 0; begin < crossShard.size(); begin += step) {
+            size_t end = min(crossShard.size(), begin + step);
+            done.push_back(pool.submit([this, &crossShard, begin, end]() {
+                for (size_t i = begin; i < end; i++) {
+                    processProc(*crossShard[i]);
+                }
+            }));
         }
+        for (future<void>& f : done) {
+            f.wait();
+        }
+        syncJournal();
+    }
+
+    // Worker body for execProcs: drain own shards, then steal
+    void runShards(vector<ShardQueue>& queues, int self) {
+        while (ProcShard* shard = nextShard(queues, self)) {
+            for (Proc* proc : *shard) {
+                Metrics::Stamp start = Metrics::start();
+                applyProc(*proc);
+                metrics.record(Metric::Execute, start);
+            }
+        }
+    }
 
-        for (int i = 0; i < procCnt; i++) {
-            procThreads[i].join();
+    ProcShard* nextShard(vector<ShardQueue>& queues, int self) {
+        int workers = (int)queues.size();
+        for (int k = 0; k < workers; k++) {
+            ShardQueue& q = queues[(self + k) % workers];
+            lock_guard<mutex> lock(q.m);
+            if (q.shards.empty()) {
+                continue;
+            }
+            ProcShard* shard;
+            if (k == 0) {
+                shard = q.shards.front();
+                q.shards.pop_front();
+            } else {
+                shard = q.shards.back();
+                q.shards.pop_back();
+            }
+            return shard;
         }
+        return nullptr;
+    }
+
+    // Find a process by TID
+    Proc* findProc(int tid) {
+        lock_guard<mutex> lock(bankMutex);
+        return tid >= 1 && tid < nextTid ? &procs[tid - 1] : nullptr;
     }
 
     // Process a single transaction
     void processProc(Proc& proc) {
+        Metrics::Stamp start = Metrics::start();
+        unique_lock<mutex> first, second;
+        lockAccs(proc, first, second);
+        applyProc(proc);
+        metrics.record(Metric::Execute, start);
+    }
+
+    // Apply a transaction; the caller must own its accounts
+    void applyProc(Proc& proc) {
+        proc.remTime = 0; // Ran, the schedulers must not run it again
         Acc* acc = getAccById(proc.accId);
         if (!acc) {
-            cout << "Error: Account not found for transaction ID " << proc.tid << endl;
+            proc.status = ProcStatus::Failed;
+            metrics.countOutcome(false);
+            if (journal.isOpen()) {
+                journalProc(JournalOp::ApplyProcess, proc, 0);
+            }
+            publish(EventKind::ProcExecuted, (uint8_t)ProcResult::AccountNotFound, proc.tid, proc.accId, proc.type, proc.amount);
+            return;
+        }
+
+        uint32_t now = currentPeriod();
+        postAccrual(acc, now);
+        Acc* to = proc.type == ProcType::Transfer ? getAccById(proc.toAccId) : nullptr;
+        if (to && to != acc) {
+            postAccrual(to, now);
+        }
+        // createProc checked the funds, but a fee posted since may have
+        // taken them
+        Acc* credited = proc.type == ProcType::Deposit ? acc : to;
+        ProcResult why = proc.type == ProcType::Transfer && !to ? ProcResult::AccountNotFound
+                       : to == acc ? ProcResult::SameAccount
+                       : proc.type != ProcType::Deposit && acc->balance < proc.amount ? ProcResult::InsufficientFunds
+                       : credited && credited->balance > INT64_MAX - proc.amount ? ProcResult::BalanceOverflow
+                       : ProcResult::Completed;
+        if (why != ProcResult::Completed) {
+            metrics.countOutcome(false);
+            proc.status = ProcStatus::Failed;
+            if (journal.isOpen()) {
+                journalProc(JournalOp::ApplyProcess, proc, acc->balance);
+            }
+            publish(EventKind::ProcExecuted, (uint8_t)why, proc.tid, proc.accId, proc.type, proc.amount);
             return;
         }
+        if (proc.type == ProcType::Deposit) {
+            AccWrite write(acc);
+            acc->setBalance(acc->balance + proc.amount);
+        } else if (proc.type == ProcType::Withdraw) {
+            AccWrite write(acc);
+            acc->setBalance(acc->balance - proc.amount);
+        } else if (proc.type == ProcType::Transfer) {
+            AccWrite write(acc, to);
+            acc->setBalance(acc->balance - proc.amount);
+            to->setBalance(to->balance + proc.amount);
+        }
+        proc.status = ProcStatus::Completed;
+        metrics.countOutcome(true);
+        if (journal.isOpen()) {
+            journalProc(JournalOp::ApplyProcess, proc, acc->balance, to ? to->balance : 0);
+        }
+        publish(EventKind::ProcExecuted, (uint8_t)ProcResult::Completed, proc.tid, proc.accId, proc.type, proc.amount);
+    }
 
-        lock_guard<mutex> lock(acc->accMutex);
-        if (proc.type == "Deposit") {
-            acc->balance += proc.amount;
-        } else if (proc.type == "Withdraw") {
-            acc->balance -= proc.amount;
+    // Post interest and fees to every account that has missed a period,
+    // spread over the pool. Accounts that transactions touched since the
+    // period began are posted already and are skipped, and nothing is
+    // scanned again until the next period. Returns how many accounts were
+    // posted to.
+    long sweepAccrual() {
+        uint32_t now = currentPeriod();
+        lock_guard<mutex> owner(shardMutex); // No execProcs shard owns an account meanwhile
+        if (now == 0 || now == sweptPeriod) {
+            return 0;
+        }
+        int accCnt = nextAccId.load(memory_order_acquire) - 1;
+        int workers = (int)pool.size();
+        int step = (accCnt + workers - 1) / workers;
+        vector<long> posted(workers, 0);
+        vector<future<void>> done;
+        for (int w = 0; w * step < accCnt; w++) {
+            done.push_back(pool.submit([this, &posted, w, step, accCnt, now]() {
+                for (int i = w * step; i < min(accCnt, (w + 1) * step); i++) {
+                    Acc* acc = accById[i];
+                    if (!acc->loadActive() || acc->loadAccrued() >= now) {
+                        continue;
+                    }
+                    lock_guard<mutex> lock(accMutex(acc->accId));
+                    if (acc->active && postAccrual(acc, now)) {
+                        posted[w]++;
+                    }
+                }
+            }));
+        }
+        for (future<void>& f : done) {
+            f.wait();
         }
-        proc.status = "Completed";
-        cout << "Transaction TID " << proc.tid << " (" << proc.type << ") processed successfully.\n";
+        syncJournal();
+        sweptPeriod = now;
+        long total = 0;
+        for (long count : posted) {
+            total += count;
+        }
+        return total;
+    }
+
+    // Run sweepAccrual every intervalMs until the bank is destroyed, so
+    // dormant accounts are posted once a period instead of leaving every
+    // missed period to their next read or transaction
+    void startAccrualSweep(int intervalMs) {
+        sweeper = thread([this, intervalMs]() {
+            unique_lock<mutex> lock(sweepMutex);
+            while (!sweepCv.wait_for(lock, chrono::milliseconds(intervalMs), [this]() { return stopSweeping; })) {
+                lock.unlock();
+                sweepAccrual();
+                lock.lock();
+            }
+        });
     }
 
     // Print all processes
@@ -147,92 +1892,404 @@ public:
         lock_guard<mutex> lock(bankMutex);
         cout << "\nProcess Table:\n";
         cout << "TID\tAID\tType\tAmount\tStatus\n";
-        for (int i = 0; i < procCnt; i++) {
-            cout << procs[i].tid << "\t" << procs[i].accId << "\t"
-                 << procs[i].type << "\t" << procs[i].amount << "\t"
-                 << procs[i].status << endl;
+        for (int i = 0; i < procs.size(); i++) {
+            cout << procs[i].tid << "\t" << procs[i].accId;
+            if (procs[i].type == ProcType::Transfer) {
+                cout << "->" << procs[i].toAccId;
+            }
+            cout << "\t" << typeName(procs[i].type) << "\t" << formatMoney(procs[i].amount) << "\t"
+                 << statusName(procs[i].status) << endl;
         }
     }
 
-    // Round Robin Scheduling
-    void roundRobinSched(int timeQuantum) {
-        cout << "\nExecuting Round Robin Scheduling with Time Quantum: " << timeQuantum << " units\n";
+    // Simulate sched over the processes with time left (rem[i] > 0) at
+    // time 0 without touching them. rem is used up; start and end get the
+    // first run and completion time of each process, finished its indices
+    // in completion order. Returns the total time taken.
+    int simulateSched(Scheduler& sched, vector<int>& rem, vector<int>& start, vector<int>& end,
+                      vector<int>& finished, bool printChart) {
+        for (int i = 0; i < (int)rem.size(); i++) {
+            if (rem[i] > 0) {
+                sched.ready(i, procs[i], rem[i]);
+            }
+        }
         int currTime = 0;
-        bool procsLeft = true;
-        int totalCpuTime = 0; // Track total CPU time for CPU utilization
-        int totalWaitTime = 0; // Track total waiting time for average calculation
-        int totalTurnTime = 0; // Track total turnaround time for average calculation
+        int i, timeSlice;
+        while (sched.pick(i, timeSlice)) {
+            if (printChart) {
+                cout << " T" << procs[i].tid << " |"; // Mark the process in the Gantt chart
+            }
+            if (start[i] < 0) {
+                start[i] = currTime;
+            }
+            timeSlice = min(timeSlice, rem[i]);
+            rem[i] -= timeSlice;
+            currTime += timeSlice;
+            if (rem[i] > 0) {
+                sched.ready(i, procs[i], rem[i]); // Back to the policy for its next slice
+            } else {
+                end[i] = currTime;
+                finished.push_back(i);
+            }
+        }
+        return currTime;
+    }
+
+    // CPU time process i still needs; 0 once it has run, whichever way
+    // it was executed, so no scheduler applies it twice
+    int pendingTime(int i) {
+        return procs[i].status == ProcStatus::Pending ? procs[i].remTime : 0;
+    }
+
+    // Run the pending processes under sched. Waiting time comes from the
+    // completion time (turnaround minus the CPU time it needed). The
+    // transactions run once the simulation is over, in completion order.
+    void runSched(Scheduler& sched) {
+        cout << "\nExecuting " << sched.describe() << "\n";
+        int n = procs.size();
+        vector<int> rem(n), needed(n), start(n, -1), end(n, 0), finished;
+        int pending = 0;
+        for (int i = 0; i < n; i++) {
+            rem[i] = needed[i] = pendingTime(i);
+            pending += rem[i] > 0;
+        }
+        if (pending == 0) {
+            cout << "No pending processes to schedule.\n";
+            return;
+        }
 
         // Print the Gantt Chart
         cout << "\nGantt Chart:\n|";
-        while (procsLeft) {
-            procsLeft = false;
-            for (int i = 0; i < procCnt; i++) {
-                if (procs[i].remTime > 0) {
-                    procsLeft = true;
-                    cout << " T" << procs[i].tid << " |"; // Mark the process in the Gantt chart
-                    int timeSlice = min(timeQuantum, procs[i].remTime);
-                    procs[i].remTime -= timeSlice;
-                    currTime += timeSlice;
-                    totalCpuTime += timeSlice; // Add time slice to CPU usage
-
-                    // Update waiting time and turnaround time for remaining processes
-                    for (int j = 0; j < procCnt; j++) {
-                        if (j != i && procs[j].remTime > 0) {
-                            procs[j].waitTime += timeSlice;
+        int totalTime = simulateSched(sched, rem, start, end, finished, true);
+        int totalCpuTime = totalTime; // Every process is ready at 0, so the CPU never idles
+        cout << endl;
+
+        for (int i : finished) {
+            Proc& proc = procs[i];
+            proc.remTime = 0;
+            if (proc.startTime < 0) {
+                proc.startTime = start[i];
+            }
+            proc.endTime = end[i];
+            proc.turnTime = end[i]; // Turnaround time is the time at which the process completes
+            proc.waitTime += end[i] - needed[i];
+        }
+        for (int i : finished) {
+            processProc(procs[i]); // Sets the status
+        }
+        eventLog.flush();
+        syncJournal();
+        // Print the scheduling metrics after the processes are completed
+        printSchedMetrics(totalTime, totalCpuTime, finished, "units");
+    }
+
+    // Run the pending processes for real on the worker pool under sched.
+    // Each burst unit is BURST_UNIT_US of CPU work, so a slice is actual
+    // time on a worker; the transaction is applied when its last slice
+    // ends. Wait and turnaround are measured wall-clock microseconds from
+    // the start of the run (turnaround minus time spent running).
+    void liveSched(Scheduler& sched) {
+        int workers = (int)pool.size();
+        cout << "\nExecuting " << sched.describe() << " on " << workers << " worker threads (1 unit = "
+             << BURST_UNIT_US << " us)\n";
+        int n = procs.size();
+        vector<int> rem(n), which;
+        vector<int64_t> busyNs(n, 0);
+        for (int i = 0; i < n; i++) {
+            rem[i] = pendingTime(i);
+            if (rem[i] > 0) {
+                sched.ready(i, procs[i], rem[i]);
+                which.push_back(i);
+            }
+        }
+        if (which.empty()) {
+            cout << "No pending processes to schedule.\n";
+            return;
+        }
+
+        mutex schedMutex; // Guards sched, rem and running
+        condition_variable schedCv;
+        int running = 0;  // Slices in flight; their processes may come back
+        long slices = 0;
+        auto t0 = chrono::steady_clock::now();
+        auto sinceStartUs = [t0]() {
+            return (int64_t)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - t0).count();
+        };
+
+        vector<future<void>> done;
+        for (int w = 0; w < workers; w++) {
+            done.push_back(pool.submit([&]() {
+                unique_lock<mutex> lock(schedMutex);
+                while (true) {
+                    int i, timeSlice;
+                    if (!sched.pick(i, timeSlice)) {
+                        if (running == 0) {
+                            schedCv.notify_all();
+                            return;
                         }
+                        schedCv.wait(lock);
+                        continue;
+                    }
+                    timeSlice = min(timeSlice, rem[i]);
+                    rem[i] -= timeSlice;
+                    running++;
+                    slices++;
+                    Proc& proc = procs[i];
+                    if (proc.startTime < 0) {
+                        proc.startTime = (int)sinceStartUs();
+                    }
+                    lock.unlock();
+
+                    auto sliceStart = chrono::steady_clock::now();
+                    auto sliceEnd = sliceStart + chrono::microseconds((int64_t)timeSlice * BURST_UNIT_US);
+                    while (chrono::steady_clock::now() < sliceEnd) {
+                        // The slice's CPU work
+                    }
+                    bool finished = rem[i] == 0; // Only this worker holds process i
+                    if (finished) {
+                        processProc(proc);
                     }
+                    busyNs[i] += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - sliceStart).count();
 
-                    if (procs[i].remTime == 0) {
-                        procs[i].turnTime = currTime; // Turnaround time is the time at which the process completes
-                        procs[i].status = "Completed"; // Mark the process as completed
-                        processProc(procs[i]);
+                    lock.lock();
+                    running--;
+                    if (finished) {
+                        proc.remTime = 0;
+                        proc.endTime = (int)sinceStartUs();
+                        proc.turnTime = proc.endTime;
+                        proc.waitTime = proc.turnTime - (int)(busyNs[i] / 1000);
+                    } else {
+                        sched.ready(i, proc, rem[i]);
                     }
+                    schedCv.notify_all();
                 }
+            }));
+        }
+        for (future<void>& f : done) {
+            f.wait();
+        }
+        int64_t wallUs = sinceStartUs();
+        int64_t totalBusyNs = 0;
+        for (int i : which) {
+            totalBusyNs += busyNs[i];
+        }
+        eventLog.flush();
+        syncJournal();
+        cout << "\nRan " << slices << " slices in " << wallUs << " us\n";
+        printSchedMetrics(wallUs * workers, totalBusyNs / 1000, which, "us");
+    }
+
+    // Round Robin Scheduling
+    void roundRobinSched(int timeQuantum) {
+        if (timeQuantum <= 0) {
+            cout << "Error: Time quantum must be positive.\n";
+            return;
+        }
+        RoundRobinScheduler sched(timeQuantum);
+        runSched(sched);
+    }
+
+    // Simulate every policy on the pending processes and print their
+    // averages side by side; nothing is executed
+    void compareScheds(int timeQuantum) {
+        if (timeQuantum <= 0) {
+            cout << "Error: Time quantum must be positive.\n";
+            return;
+        }
+        RoundRobinScheduler rr(timeQuantum);
+        SrtfScheduler srtf;
+        PriorityScheduler prio;
+        MlfqScheduler mlfq(timeQuantum);
+        Scheduler* scheds[] = {&rr, &srtf, &prio, &mlfq};
+
+        int n = procs.size();
+        vector<int> needed(n);
+        int pending = 0;
+        for (int i = 0; i < n; i++) {
+            needed[i] = pendingTime(i);
+            pending += needed[i] > 0;
+        }
+        if (pending == 0) {
+            cout << "No pending processes to schedule.\n";
+            return;
+        }
+        cout << "\nPolicy comparison over " << pending << " pending processes:\n";
+        cout << "AvgWait\tAvgTurn\tPolicy\n";
+        cout << fixed << setprecision(2);
+        for (Scheduler* sched : scheds) {
+            vector<int> rem = needed, start(n, -1), end(n, 0), finished;
+            simulateSched(*sched, rem, start, end, finished, false);
+            double wait = 0, turn = 0;
+            for (int i : finished) {
+                wait += end[i] - needed[i];
+                turn += end[i];
             }
+            cout << wait / pending << "\t" << turn / pending << "\t" << sched->describe() << "\n";
         }
+    }
 
-        cout << endl;
-        // Print the scheduling metrics after the processes are completed
-        printSchedMetrics(currTime, totalCpuTime);
+    // Print memory used by account and process storage
+    void printStorageUsage() {
+        lock_guard<mutex> lock(bankMutex);
+        size_t accBytes = accs.bytesUsed() + accById.bytesUsed();
+        cout << "\nStorage Usage:\n";
+        cout << "Accounts: " << accs.size() << " (" << accBytes << " bytes";
+        if (accs.size() > 0) {
+            cout << ", " << accBytes / accs.size() << " bytes per account";
+        }
+        cout << ")\n";
+        cout << "Customers: " << custs.size() << " (" << custs.bytesUsed() << " bytes)\n";
+        cout << "Processes: " << procs.size() << " (" << procs.bytesUsed() << " bytes)\n";
     }
 
-    void printSchedMetrics(int totalTime, int totalCpuTime) {
+    // Metrics for the processes in which, with times given in unit
+    void printSchedMetrics(int64_t totalTime, int64_t totalCpuTime, const vector<int>& which, const char* unit) {
         double avgWaitTime = 0, avgTurnTime = 0;
         double cpuUtilization = (double)totalCpuTime / totalTime * 100; // Calculate CPU utilization
 
         cout << "\nProcess Metrics:\n";
         cout << "TID\tBurst\tWaitTime\tTurnTime\tStatus\n";
-        for (int i = 0; i < procCnt; i++) {
+        for (int i : which) {
             avgWaitTime += procs[i].waitTime;
             avgTurnTime += procs[i].turnTime;
             cout << procs[i].tid << "\t" << procs[i].burstTime << "\t"
                  << procs[i].waitTime << "\t" << procs[i].turnTime
-                 << "\t\t" << procs[i].status << endl;
+                 << "\t\t" << statusName(procs[i].status) << endl;
         }
 
-        avgWaitTime /= procCnt;
-        avgTurnTime /= procCnt;
+        avgWaitTime /= which.size();
+        avgTurnTime /= which.size();
         cout << fixed << setprecision(2);
-        cout << "\nAverage Waiting Time: " << avgWaitTime << " units\n";
-        cout << "Average Turnaround Time: " << avgTurnTime << " units\n";
+        cout << "\nAverage Waiting Time: " << avgWaitTime << " " << unit << "\n";
+        cout << "Average Turnaround Time: " << avgTurnTime << " " << unit << "\n";
         cout << "CPU Utilization: " << cpuUtilization << "%" << endl; // Display CPU utilization
     }
 };
 
+// Benchmark workload, the same in code1, code2 and Module 1-4 so their
+// CSV rows can be compared: BENCH_ACCS accounts, then every thread
+// creates and executes BENCH_OPS transactions of BENCH_AMOUNT. Accounts
+// are picked uniformly, or for the hot workload BENCH_HOT_PERCENT of
+// operations go to the first BENCH_HOT accounts.
+const int BENCH_ACCS = 1024;
+const int BENCH_HOT = 4;
+const int BENCH_HOT_PERCENT = 80;
+const int BENCH_OPS = 100000;      // Per thread
+const int BENCH_SAMPLE = 16;       // Time one in this many operations
+const Money BENCH_AMOUNT = 100;
+const Money BENCH_BALANCE = 1000000000000LL; // Withdrawals never run out
+
+// Deterministic per-thread operation stream (xorshift32)
+struct BenchStream {
+    uint32_t state;
+    bool hot;
+    int withdrawPercent;
+
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    int account() {
+        bool toHot = hot && next() % 100 < (uint32_t)BENCH_HOT_PERCENT;
+        return 1 + (int)(next() % (toHot ? BENCH_HOT : BENCH_ACCS));
+    }
+    bool withdraw() { return next() % 100 < (uint32_t)withdrawPercent; }
+};
+
+// q-th percentile of samples, which get reordered
+uint32_t benchPercentile(vector<uint32_t>& samples, double q) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t k = min(samples.size() - 1, (size_t)(q * samples.size()));
+    nth_element(samples.begin(), samples.begin() + k, samples.end());
+    return samples[k];
+}
+
+// Run the uniform and hot workloads with 1, 2, 4 ... maxThreads threads
+// and print one CSV row per run. Every run gets a fresh bank, so
+// maxThreads is capped where the process table would run out.
+void runBenchmark(unsigned maxThreads, int withdrawPercent) {
+    maxThreads = min(maxThreads, (unsigned)(MAX_PROCS / BENCH_OPS));
+    vector<unsigned> threadCounts;
+    for (unsigned n = 1; n < maxThreads; n *= 2) {
+        threadCounts.push_back(n);
+    }
+    threadCounts.push_back(maxThreads);
+
+    cout << "variant,workload,threads,ops,ops_per_sec,speedup,p50_ns,p99_ns" << endl;
+    for (int hot = 0; hot < 2; hot++) {
+        double baseRate = 0;
+        for (unsigned threadCount : threadCounts) {
+            unique_ptr<BankSystem> bank(new BankSystem(false));
+            for (int a = 0; a < BENCH_ACCS; a++) {
+                bank->createAcc("bench", BENCH_BALANCE);
+            }
+            vector<vector<uint32_t>> samples(threadCount);
+            vector<thread> threads;
+            auto start = chrono::steady_clock::now();
+            for (unsigned t = 0; t < threadCount; t++) {
+                threads.emplace_back([&, t]() {
+                    BenchStream ops{2654435761u * (t + 1), hot == 1, withdrawPercent};
+                    vector<uint32_t>& mine = samples[t];
+                    mine.reserve(BENCH_OPS / BENCH_SAMPLE + 1);
+                    for (int op = 0; op < BENCH_OPS; op++) {
+                        bool timed = op % BENCH_SAMPLE == 0;
+                        auto opStart = timed ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+                        int accId = ops.account();
+                        ProcType type = ops.withdraw() ? ProcType::Withdraw : ProcType::Deposit;
+                        bank->processProc(*bank->findProc(bank->createProc(accId, type, BENCH_AMOUNT)));
+                        if (timed) {
+                            mine.push_back((uint32_t)chrono::duration_cast<chrono::nanoseconds>(
+                                chrono::steady_clock::now() - opStart).count());
+                        }
+                    }
+                });
+            }
+            for (thread& t : threads) {
+                t.join();
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            long ops = (long)threadCount * BENCH_OPS;
+            double rate = ops / seconds;
+            if (baseRate == 0) {
+                baseRate = rate;
+            }
+            vector<uint32_t> all;
+            for (vector<uint32_t>& mine : samples) {
+                all.insert(all.end(), mine.begin(), mine.end());
+            }
+            uint32_t p50 = benchPercentile(all, 0.50);
+            uint32_t p99 = benchPercentile(all, 0.99);
+            cout << "module," << (hot ? "hot" : "uniform") << "/w" << withdrawPercent << "," << threadCount << ","
+                 << ops << "," << fixed << setprecision(0) << rate << "," << setprecision(2) << rate / baseRate
+                 << "," << p50 << "," << p99 << endl;
+        }
+    }
+}
+
 // Menu
 void menu(BankSystem &bank) 
 {
     while (true) {
+        bank.events().flush(); // Print pending messages before the menu
         cout << "\n------ Banking System ------\n";
         cout << "1. Create Account\n";
         cout << "2. Deposit\n";
         cout << "3. Withdraw\n";
         cout << "4. Check Balance\n";
         cout << "5. Display All Processes\n";
-        cout << "6. Execute Round Robin Scheduling\n";
+        cout << "6. Execute CPU Scheduling\n";
         cout << "7. Execute All Transactions (Multithreading)\n";
-        cout << "8. Exit\n";
+        cout << "8. Storage Usage\n";
+        cout << "9. Bulk Load Accounts\n";
+        cout << "10. Transfer\n";
+        cout << "11. Latency Metrics\n";
+        cout << "12. Customer Accounts\n";
+        cout << "13. Post Interest and Fees\n";
+        cout << "14. Exit\n";
         cout << "Enter option: ";
         int option;
         cin >> option;
@@ -245,7 +2302,7 @@ void menu(BankSystem &bank)
             cin >> custId;
             cout << "Enter Initial Balance: ";
             cin >> initBalance;
-            bank.createAcc(custId, initBalance);
+            bank.createAcc(custId, toMoney(initBalance));
             break;
         }
         case 2: {
@@ -255,7 +2312,7 @@ void menu(BankSystem &bank)
             cin >> accId;
             cout << "Enter Deposit Amount: ";
             cin >> amount;
-            bank.createProc(accId, "Deposit", amount);
+            bank.createProc(accId, ProcType::Deposit, toMoney(amount));
             break;
         }
         case 3: {
@@ -265,7 +2322,7 @@ void menu(BankSystem &bank)
             cin >> accId;
             cout << "Enter Withdrawal Amount: ";
             cin >> amount;
-            bank.createProc(accId, "Withdraw", amount);
+            bank.createProc(accId, ProcType::Withdraw, toMoney(amount));
             break;
         }
         case 4: {
@@ -279,16 +2336,72 @@ void menu(BankSystem &bank)
             bank.printProcs();
             break;
         case 6: {
-            int timeQuantum;
-            cout << "Enter Time Quantum for Round Robin: ";
-            cin >> timeQuantum;
-            bank.roundRobinSched(timeQuantum);
+            int policy;
+            int timeQuantum = 0;
+            cout << "Policy (1 = Round Robin, 2 = SJF/SRTF, 3 = Priority, 4 = MLFQ, 5 = Compare All): ";
+            cin >> policy;
+            if (policy == 1 || policy == 4 || policy == 5) {
+                cout << "Enter Time Quantum: ";
+                cin >> timeQuantum;
+            }
+            if (policy == 5) {
+                bank.compareScheds(timeQuantum);
+                break;
+            }
+            unique_ptr<Scheduler> sched = makeScheduler(policy, timeQuantum);
+            if (!sched) {
+                cout << "Invalid option.\n";
+                break;
+            }
+            int mode;
+            cout << "Mode (1 = Simulated, 2 = Live on worker threads): ";
+            cin >> mode;
+            if (mode == 2) {
+                bank.liveSched(*sched);
+            } else {
+                bank.runSched(*sched);
+            }
             break;
         }
         case 7:
             bank.execProcs();
             break;
         case 8:
+            bank.printStorageUsage();
+            break;
+        case 9: {
+            string path;
+            cout << "Enter CSV file (customerID,balance per line): ";
+            cin >> path;
+            bank.bulkLoadAccs(path);
+            break;
+        }
+        case 10: {
+            int fromAccId, toAccId;
+            double amount;
+            cout << "Enter Source Account ID: ";
+            cin >> fromAccId;
+            cout << "Enter Destination Account ID: ";
+            cin >> toAccId;
+            cout << "Enter Transfer Amount: ";
+            cin >> amount;
+            bank.createTransfer(fromAccId, toAccId, toMoney(amount));
+            break;
+        }
+        case 11:
+            bank.stats().print(cout);
+            break;
+        case 12: {
+            string custId;
+            cout << "Enter Customer ID: ";
+            cin >> custId;
+            bank.printCustAccs(custId);
+            break;
+        }
+        case 13:
+            cout << "Posted interest and fees to " << bank.sweepAccrual() << " accounts\n";
+            break;
+        case 14:
             cout << "Exiting...\n";
             return;
         default:
@@ -297,10 +2410,54 @@ void menu(BankSystem &bank)
     }
 }
 
-int main() 
+int main(int argc, char* argv[]) 
 {
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        unsigned maxThreads = argc > 2 ? (unsigned)stoul(argv[2]) : thread::hardware_concurrency();
+        int withdrawPercent = argc > 3 ? stoi(argv[3]) : 50;
+        runBenchmark(max(1u, maxThreads), min(max(withdrawPercent, 0), 100));
+        return 0;
+    }
     BankSystem bank;
+    string metricsPath;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        if (option == "--event-log") {
+            unique_ptr<BinaryFileSink> sink(new BinaryFileSink(argv[i + 1]));
+            if (!sink->isOpen()) {
+                cout << "Error: Cannot open event log " << argv[i + 1] << endl;
+                return 1;
+            }
+            bank.events().addSink(move(sink));
+        } else if (option == "--journal") {
+            if (!bank.openJournal(argv[i + 1])) {
+                cout << "Error: Cannot open journal " << argv[i + 1] << endl;
+                return 1;
+            }
+        } else if (option == "--metrics") {
+            metricsPath = argv[i + 1];
+        } else if (option == "--accrual") {
+            AccrualTerms terms;
+            double fee = 0;
+            if (sscanf(argv[i + 1], "%d,%lf,%d", &terms.rateBp, &fee, &terms.periodSeconds) != 3 ||
+                terms.rateBp < 0 || fee < 0 || terms.periodSeconds <= 0) {
+                cout << "Error: --accrual takes RATE_BP,FEE,PERIOD_SECONDS" << endl;
+                return 1;
+            }
+            terms.fee = toMoney(fee);
+            bank.setAccrual(terms);
+        } else if (option == "--accrual-sweep") {
+            bank.startAccrualSweep(max(1, atoi(argv[i + 1])));
+        } else {
+            cout << "Unknown option: " << option << endl;
+            return 1;
+        }
+    }
     menu(bank);
+    if (!metricsPath.empty() && !bank.stats().dump(metricsPath)) {
+        cout << "Error: Cannot write metrics to " << metricsPath << endl;
+        return 1;
+    }
     return 0;
 }
 
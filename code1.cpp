@@ -3,44 +3,114 @@
 #include <iostream>
 #include <string>
 #include <mutex>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <iomanip>
+#include <new>
+#include <utility>
+#include <cstdint>
+#include <cmath>
 using namespace std;
-const int MaxAcc = 1000;
-const int MaxProc = 100;
+typedef int64_t Money; // Amount in cents
+const double MaxUnits = 9e16; // Amounts in units below this fit Money in cents
+// Convert an entered amount to cents, -1 (rejected everywhere) if not finite or too large
+Money to_money(double v) { return fabs(v) < MaxUnits ? llround(v * 100) : -1; }
+// Format cents as units.cents
+string money_str(Money m) {
+    string sign = m < 0 ? "-" : "";
+    if (m < 0) m = -m;
+    string c = to_string(m % 100);
+    return sign + to_string(m / 100) + (c.size() < 2 ? ".0" : ".") + c;
+}
+enum class PType : uint8_t { Deposit, Withdraw, Transfer };
+enum class PStat : uint8_t { Pending, Completed, Failed };
+const char* type_str(PType t) {
+    return t == PType::Deposit ? "Deposit" : t == PType::Withdraw ? "Withdraw" : t == PType::Transfer ? "Transfer" : "Unknown";
+}
+const char* stat_str(PStat s) {
+    return s == PStat::Pending ? "Pending" : s == PStat::Completed ? "Completed" : "Failed";
+}
+const int MaxAcc = 1 << 24;
+const int MaxProc = 1 << 24;
+const int ChunkSz = 4096; // Records per arena chunk
+// Chunked arena, grows a chunk at a time so records never move
+template <typename T, int Cap>
+struct Arena {
+    T* chunks[(Cap + ChunkSz - 1) / ChunkSz] = {};
+    int nChunks = 0;
+    int cnt = 0;
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() { // Free everything in bulk
+        for (int i = 0; i < cnt; i++) {
+            at(i).~T();
+        }
+        for (int c = 0; c < nChunks; c++) {
+            ::operator delete(chunks[c]);
+        }
+    }
+    T& at(int i) { return chunks[i / ChunkSz][i % ChunkSz]; }
+    bool full() const { return cnt >= Cap; }
+    template <typename... Args>
+    T& push(Args&&... args) {
+        if (cnt % ChunkSz == 0) {
+            chunks[nChunks++] = static_cast<T*>(::operator new(sizeof(T) * ChunkSz));
+        }
+        T* p = new (chunks[cnt / ChunkSz] + cnt % ChunkSz) T{ forward<Args>(args)... };
+        cnt++;
+        return *p;
+    }
+    size_t bytes() const { return sizeof(*this) + (size_t)nChunks * ChunkSz * sizeof(T); }
+};
 struct Acc {
     int id;
     string custId;
-    double bal;
+    Money bal;
     bool act;
 };
 struct Proc {
     int tid; // Trans ID
     int aid; // Acc ID
-    string type; // Deposit or Withdraw
-    double amt;
-    string stat; // Pending, Completed, Failed
+    PType type; // Deposit, Withdraw or Transfer
+    Money amt;
+    PStat stat; // Pending, Completed, Failed
+    int to; // Destination Acc ID of a Transfer
 };
+// Lock for a bank only one thread uses, compiles to nothing
+struct NoLock {
+    void lock() {}
+    void unlock() {}
+};
+// Bank of at most AccCap accounts and ProcCap processes, every call
+// under one Lock: mutex when threads share it, NoLock when one owns it.
+// Storage is always Arena and code1 has no scheduler; code2 and
+// Module 1-4 keep banks of their own
+template <int AccCap, int ProcCap, typename Lock>
 class BankSys {
 public:
-    Acc accs[MaxAcc];
-    Proc procs[MaxProc];
+    Arena<Acc, AccCap> accs;
+    Arena<Proc, ProcCap> procs;
     int nextAid = 1; // Next Acc ID
     int nextTid = 1; // Next Trans ID
-    int accCnt = 0;  // Account count
-    int procCnt = 0; // Process count
-    mutex mtx;
+    Arena<int, AccCap> accSlot; // Acc ID - 1 -> index in accs (IDs are dense)
+    Arena<int, ProcCap> procSlot; // Trans ID - 1 -> index in procs (IDs are dense)
+    Lock mtx;
     // Find an account by ID
     Acc* find_acc(int id) {
-        for (int i = 0; i < accCnt; i++) {
-            if (accs[i].act && accs[i].id == id) {
-                return &accs[i];
-            }
+        if (id < 1 || id >= nextAid) {
+            return nullptr;
         }
-        return nullptr;
+        Acc* a = &accs.at(accSlot.at(id - 1));
+        return a->act ? a : nullptr;
     }
     // Create an account
-    int create_acc(const string& cid, double bal) {
-        lock_guard<mutex> lock(mtx);
-        if (accCnt >= MaxAcc) {
+    int create_acc(const string& cid, Money bal) {
+        lock_guard<Lock> lock(mtx);
+        if (accs.full()) {
             cout << "Error: Max accounts reached "<<endl;
             return -1;
         }
@@ -49,63 +119,101 @@ public:
             return -1;
         }
         int id = nextAid++;
-        accs[accCnt++] = { id, cid, bal, true };
+        accSlot.push(accs.cnt);
+        accs.push(id, cid, bal, true);
         return id;
     }
-    // Create a process
-    int create_proc(int aid, const string& type, double amt) {
-        lock_guard<mutex> lock(mtx);
-        if (procCnt >= MaxProc) {
+    // Find a process by ID
+    Proc* find_proc(int tid) {
+        if (tid < 1 || tid >= nextTid) {
+            return nullptr;
+        }
+        return &procs.at(procSlot.at(tid - 1));
+    }
+    // Create a process, to is the destination of a Transfer
+    int create_proc(int aid, PType type, Money amt, int to = 0) {
+        lock_guard<Lock> lock(mtx);
+        if (procs.full()) {
             cout << "Error: Max processes reached "<<endl;
             return -1;
         }
         int tid = nextTid++;
-        procs[procCnt++] = { tid, aid, type, amt, "Pending" };
+        procSlot.push(procs.cnt);
+        procs.push(tid, aid, type, amt, PStat::Pending, to);
         return tid;
     }
     // Execute a process
     bool exec_proc(int tid) {
-        lock_guard<mutex> lock(mtx);
-        for (int i = 0; i < procCnt; i++) {
-            if (procs[i].tid == tid) {
-                Proc& p = procs[i];
-                Acc* a = find_acc(p.aid);
-                if (!a) {
-                    cout << "Error: Account not found for transaction " << tid << endl;
-                    p.stat = "Failed";
-                    return false;
-                }
-                if (p.type == "Deposit") {
-                    if (p.amt <= 0) {
-                        cout << "Error: Invalid deposit amount "<<endl;
-                        p.stat = "Failed";
-                        return false;
-                    }
-                    a->bal =a->bal+ p.amt;
-                    p.stat = "Completed";
-                }
-                else if (p.type == "Withdraw") {
-                    if (p.amt <= 0 || a->bal < p.amt) {
-                        cout << "Error: Insufficient funds or invalid withdrawal amount.\n";
-                        p.stat = "Failed";
-                        return false;
-                    }
-                    a->bal =a->bal- p.amt;
-                    p.stat = "Completed";
-                }
-                else {
-                    cout << "Error: Unknown transaction type "<<endl;
-                    p.stat = "Failed";
-                    return false;
-                }
-                return true;
+        lock_guard<Lock> lock(mtx);
+        Proc* pp = find_proc(tid);
+        if (!pp) {
+            cout << "Error: Transaction not found.\n";
+            return false;
+        }
+        Proc& p = *pp;
+        if (p.stat != PStat::Pending) {
+            cout << "Error: Transaction " << tid << " already executed.\n";
+            return false;
+        }
+        Acc* a = find_acc(p.aid);
+        if (!a) {
+            cout << "Error: Account not found for transaction " << tid << endl;
+            p.stat = PStat::Failed;
+            return false;
+        }
+        if (p.type == PType::Deposit) {
+            if (p.amt <= 0) {
+                cout << "Error: Invalid deposit amount "<<endl;
+                p.stat = PStat::Failed;
+                return false;
             }
+            if (a->bal > INT64_MAX - p.amt) {
+                cout << "Error: Deposit would exceed the largest balance.\n";
+                p.stat = PStat::Failed;
+                return false;
+            }
+            a->bal =a->bal+ p.amt;
+            p.stat = PStat::Completed;
         }
-        cout << "Error: Transaction not found.\n";
-        return false;
+        else if (p.type == PType::Withdraw) {
+            if (p.amt <= 0 || a->bal < p.amt) {
+                cout << "Error: Insufficient funds or invalid withdrawal amount.\n";
+                p.stat = PStat::Failed;
+                return false;
+            }
+            a->bal =a->bal- p.amt;
+            p.stat = PStat::Completed;
+        }
+        else if (p.type == PType::Transfer) { // Both sides under one lock, no money in flight
+            Acc* b = find_acc(p.to);
+            if (!b || b == a) {
+                cout << "Error: Invalid destination account for transaction " << tid << endl;
+                p.stat = PStat::Failed;
+                return false;
+            }
+            if (p.amt <= 0 || a->bal < p.amt) {
+                cout << "Error: Insufficient funds or invalid transfer amount.\n";
+                p.stat = PStat::Failed;
+                return false;
+            }
+            if (b->bal > INT64_MAX - p.amt) {
+                cout << "Error: Transfer would exceed the largest destination balance.\n";
+                p.stat = PStat::Failed;
+                return false;
+            }
+            a->bal =a->bal- p.amt;
+            b->bal =b->bal+ p.amt;
+            p.stat = PStat::Completed;
+        }
+        else {
+            cout << "Error: Unknown transaction type "<<endl;
+            p.stat = PStat::Failed;
+            return false;
+        }
+        return true;
     }                                 // Check account balance
-    double check_bal(int id) {
-        lock_guard<mutex> lock(mtx);
+    Money check_bal(int id) {
+        lock_guard<Lock> lock(mtx);
         Acc* a = find_acc(id);
         if (!a) {
             cout << "Error: Account not found "<<endl;
@@ -114,46 +222,148 @@ public:
         return a->bal;
     }                      // Display all processes
     void print_procs() {
-        lock_guard<mutex> lock(mtx);
+        lock_guard<Lock> lock(mtx);
         cout << endl;
         cout << "Process Table : " << endl;
         cout << "TID\tAID\tType\t\tAmount\tStatus"<<endl;
-        for (int i = 0; i < procCnt; i++) {
-            cout << procs[i].tid << "\t" << procs[i].aid << "\t"
-                << procs[i].type << "\t\t" << procs[i].amt << "\t"
-                << procs[i].stat << endl;
+        for (int i = 0; i < procs.cnt; i++) {
+            Proc& p = procs.at(i);
+            cout << p.tid << "\t" << p.aid;
+            if (p.type == PType::Transfer) {
+                cout << "->" << p.to;
+            }
+            cout << "\t" << type_str(p.type) << "\t\t" << money_str(p.amt) << "\t"
+                << stat_str(p.stat) << endl;
+        }
+    }                      // Display storage usage
+    void print_mem() {
+        lock_guard<Lock> lock(mtx);
+        size_t accBytes = accs.bytes() + accSlot.bytes();
+        cout << "Accounts: " << accs.cnt << ", " << accBytes << " bytes";
+        if (accs.cnt > 0) {
+            cout << " (" << accBytes / accs.cnt << " bytes per account)";
         }
+        cout << endl;
+        cout << "Processes: " << procs.cnt << ", " << procs.bytes() + procSlot.bytes() << " bytes" << endl;
+    }
+};
+typedef BankSys<MaxAcc, MaxProc, NoLock> LocalBank; // The interactive program, one thread
+// Benchmark workload, the same as code2 and Module 1-4 so the CSV rows
+// compare: BenchAcc accounts, each thread runs BenchOps create+exec
+// transactions, uniform or with BenchHotPct% of them on BenchHot accounts
+const int BenchAcc = 1024;
+const int BenchHot = 4;
+const int BenchHotPct = 80;
+const int BenchOps = 100000; // Per thread
+const int BenchSample = 16; // Time one op in this many
+const Money BenchAmt = 100;
+const Money BenchBal = 1000000000000LL; // Withdrawals never run out
+// Deterministic per-thread op stream (xorshift32)
+struct BenchStream {
+    uint32_t s;
+    bool hot;
+    int wPct;
+    uint32_t next() { s ^= s << 13; s ^= s >> 17; s ^= s << 5; return s; }
+    int acc() {
+        bool toHot = hot && next() % 100 < (uint32_t)BenchHotPct;
+        return 1 + (int)(next() % (toHot ? BenchHot : BenchAcc));
     }
+    bool withdraw() { return next() % 100 < (uint32_t)wPct; }
 };
-int main() {
-    BankSys bank;
+// q-th percentile, reorders v
+uint32_t bench_pct(vector<uint32_t>& v, double q) {
+    if (v.empty()) return 0;
+    size_t k = min(v.size() - 1, (size_t)(q * v.size()));
+    nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+// One CSV row: the workload on n threads against a fresh Bank. base is
+// the rate of the first row of the workload, set by that row.
+template <typename Bank>
+void bench_row(const char* variant, bool hot, unsigned n, int wPct, double& base) {
+    unique_ptr<Bank> bank(new Bank());
+    for (int a = 0; a < BenchAcc; a++) bank->create_acc("bench", BenchBal);
+    vector<vector<uint32_t>> samp(n);
+    vector<thread> ts;
+    auto t0 = chrono::steady_clock::now();
+    for (unsigned t = 0; t < n; t++) {
+        ts.emplace_back([&, t]() {
+            BenchStream ops{2654435761u * (t + 1), hot, wPct};
+            samp[t].reserve(BenchOps / BenchSample + 1);
+            for (int op = 0; op < BenchOps; op++) {
+                bool timed = op % BenchSample == 0;
+                auto s = timed ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+                int aid = ops.acc();
+                PType type = ops.withdraw() ? PType::Withdraw : PType::Deposit;
+                bank->exec_proc(bank->create_proc(aid, type, BenchAmt));
+                if (timed) samp[t].push_back((uint32_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - s).count());
+            }
+        });
+    }
+    for (thread& t : ts) t.join();
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    long ops = (long)n * BenchOps;
+    double rate = ops / sec;
+    if (base == 0) base = rate;
+    vector<uint32_t> all;
+    for (auto& v : samp) all.insert(all.end(), v.begin(), v.end());
+    uint32_t p50 = bench_pct(all, 0.50);
+    uint32_t p99 = bench_pct(all, 0.99);
+    cout << variant << "," << (hot ? "hot" : "uniform") << "/w" << wPct << "," << n << "," << ops << ","
+        << fixed << setprecision(0) << rate << "," << setprecision(2) << rate / base << "," << p50 << "," << p99 << endl;
+}
+// Bench bank, shared by the bench threads and sized for its accounts
+typedef BankSys<BenchAcc, MaxProc, mutex> BenchBank;
+// Uniform and hot workloads on 1, 2, 4 ... maxThr threads, one CSV row
+// each, plus a one-thread row without the lock
+void run_bench(unsigned maxThr, int wPct) {
+    vector<unsigned> thr;
+    for (unsigned n = 1; n < maxThr; n *= 2) thr.push_back(n);
+    thr.push_back(maxThr);
+    cout << "variant,workload,threads,ops,ops_per_sec,speedup,p50_ns,p99_ns" << endl;
+    for (int hot = 0; hot < 2; hot++) {
+        double base = 0;
+        for (unsigned n : thr) bench_row<BenchBank>("code1", hot == 1, n, wPct, base);
+        double localBase = 0;
+        bench_row<BankSys<BenchAcc, MaxProc, NoLock>>("code1-nolock", hot == 1, 1, wPct, localBase);
+    }
+}
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        unsigned maxThr = argc > 2 ? (unsigned)stoul(argv[2]) : thread::hardware_concurrency();
+        int wPct = argc > 3 ? stoi(argv[3]) : 50;
+        run_bench(max(1u, maxThr), min(max(wPct, 0), 100));
+        return 0;
+    }
+    LocalBank bank;
 
-    int bal1;
+    double bal1;
     cout << "Enter money for creating your account: ";
     cin >> bal1;
-    int aid = bank.create_acc("cust1", bal1);
+    int aid = bank.create_acc("cust1", to_money(bal1));
     if (aid != -1) {
-        cout << "Account " << aid << " created with balance: " << bank.check_bal(aid) << endl;
+        cout << "Account " << aid << " created with balance: " << money_str(bank.check_bal(aid)) << endl;
     }
 
-    int deposit;
+    double deposit;
     cout << "Enter the amount to deposit: ";
     cin >> deposit;
-    int depTid = bank.create_proc(aid, "Deposit", deposit);
+    int depTid = bank.create_proc(aid, PType::Deposit, to_money(deposit));
     bank.print_procs(); // Display processes before execution
     if (bank.exec_proc(depTid)) {
-        cout << "After deposit, balance: " << bank.check_bal(aid) << endl;
+        cout << "After deposit, balance: " << money_str(bank.check_bal(aid)) << endl;
     }
     bank.print_procs(); // Display processes after execution
 
-    int withdraw;
+    double withdraw;
     cout << "Enter the amount to withdraw: ";
     cin >> withdraw;
-    int wTid = bank.create_proc(aid, "Withdraw", withdraw);
+    int wTid = bank.create_proc(aid, PType::Withdraw, to_money(withdraw));
     bank.print_procs(); // Display processes before execution
     if (bank.exec_proc(wTid)) {
-        cout << "After withdrawal, balance: " << bank.check_bal(aid) << endl;
+        cout << "After withdrawal, balance: " << money_str(bank.check_bal(aid)) << endl;
     }
     bank.print_procs(); // Display processes after execution
+    bank.print_mem();
     return 0;
 }
\ No newline at end of file
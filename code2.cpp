@@ -2,171 +2,4182 @@
 #include <string>
 #include <mutex>
 #include <thread>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <queue>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+#include <new>
+#include <utility>
+#include <cstdint>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include <sstream>
+#include <csignal>
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <unistd.h> // For fork() and wait()
 #include <sys/wait.h> // For wait()
 using namespace std;
 
-const int MAX_ACCOUNTS = 1000;
-const int MAX_PROCESSES = 100;
+const int MAX_ACCOUNTS = 1 << 24;
+const int MAX_PROCESSES = 1 << 24;
+const int CHUNK_SIZE = 4096; // Records per storage chunk
+const int LOCK_STRIPES = 256; // Account locks shared by account ID hash
+const int PIN_SHARDS = 32;    // Pin counters per chunked store; threads beyond share
+const size_t EVENT_RING_SIZE = 4096; // Pending events before publishers wait
+const int GROUP_COMMIT_RECORDS = 64; // Journal records per sync at most
+const int GROUP_COMMIT_US = 1000;    // Longest a journal record waits for its sync
+const int SNAPSHOT_INTERVAL_S = 60;  // Seconds between periodic snapshots
+const int ARCHIVE_INTERVAL_MS = 1000; // Time between passes moving finished processes to the archive
+const int PROCESS_HOT_CHUNKS = 4;     // Newest process chunks that always stay in memory
+const int PROCESS_PAGE = 50;          // Processes per page of the process table
+const int CUSTOMER_SHARDS = 64;      // Customer index shards, by customer ID hash
+const int SERVER_BACKLOG = 128;      // Pending TCP connections
+const int SERVER_MAX_EVENTS = 64;    // epoll events handled per wakeup
+const size_t SERVER_MAX_LINE = 4096;   // Longest request line
+const size_t SERVER_MAX_OUT = 1 << 20; // Unsent reply bytes before a client stops being read
+const int DEDUPE_BUCKETS = 1 << 16;     // Idempotency key buckets, one cache line each (4 MB)
+const int DEDUPE_WAYS = 3;              // Keys per bucket
+const uint32_t DEDUPE_TTL_S = 600;      // Seconds a key is remembered after its last use
+const size_t HOLD_ID_MAX = 47;          // Longest two-phase transfer ID a node keeps
+const size_t CUSTOMER_ID_MAX = 255;     // Longest customer ID, journal and snapshot rows keep its length in a byte
+const int COMMIT_ATTEMPTS = 5;          // Tries a router gives each COMMIT before reporting the transfer in doubt
+const int COMMIT_RETRY_MS = 200;        // Pause before a COMMIT is sent again
 
-// Account structure
+// Money is kept as an integer count of cents (minor units)
+typedef int64_t Money;
+const double MAX_UNITS = 9e16; // Amounts in units below this fit Money in cents
+
+// Whether an amount in units is finite and converts to Money
+bool fitsMoney(double units) {
+    return fabs(units) < MAX_UNITS; // Written so nan fails too
+}
+
+// Convert an amount entered in units to cents; amounts that are not
+// finite or too large give -1, which every caller rejects
+Money toMoney(double units) {
+    return fitsMoney(units) ? llround(units * 100) : -1;
+}
+
+// Format cents as "units.cents"
+string formatMoney(Money cents) {
+    string sign = cents < 0 ? "-" : "";
+    if (cents < 0) {
+        cents = -cents;
+    }
+    string frac = to_string(cents % 100);
+    return sign + to_string(cents / 100) + (frac.size() < 2 ? ".0" : ".") + frac;
+}
+
+// Chunked arena storage: grows one chunk at a time, so records never move
+// and pointers to them stay valid. Slots are claimed with an atomic counter
+// and chunks are installed with a CAS, so appends from several threads need
+// no lock. Everything is freed in bulk on destruction.
+// CAPACITY bounds the live slots, not the slot numbers: retireFront frees
+// the oldest chunk, and its place in the ring of chunk pointers goes to a
+// chunk claimed later. Threads that use a slot of a store that retires
+// chunks must hold a Pin meanwhile.
+template <typename T, int CAPACITY>
+class ChunkedStore {
+private:
+    static const int CHUNK_COUNT = (CAPACITY + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    struct Chunk {
+        int number; // Holds slots [number * CHUNK_SIZE, (number + 1) * CHUNK_SIZE)
+        T slots[CHUNK_SIZE];
+    };
+    struct alignas(64) PinCount {
+        atomic<int> pins{0};
+    };
+    atomic<Chunk*> chunks[CHUNK_COUNT] = {}; // Chunk c at c % CHUNK_COUNT
+    atomic<int> count{0};
+    atomic<int> firstLive{0}; // Slots below were retired; a multiple of CHUNK_SIZE
+    PinCount pinCounts[PIN_SHARDS];
+
+    // Install chunk c if nobody has yet. A claim only reaches chunk c
+    // once the chunk before it in the ring was retired.
+    void installChunk(int c) {
+        atomic<Chunk*>& slot = chunks[c % CHUNK_COUNT];
+        Chunk* current = slot.load(memory_order_acquire);
+        if (current) {
+            return;
+        }
+        Chunk* fresh = new Chunk();
+        fresh->number = c;
+        if (!slot.compare_exchange_strong(current, fresh, memory_order_acq_rel)) {
+            delete fresh;
+        }
+    }
+
+    atomic<int>& pinCount() {
+        static atomic<int> nextSlot{0};
+        thread_local int slot = nextSlot.fetch_add(1, memory_order_relaxed) % PIN_SHARDS;
+        return pinCounts[slot].pins;
+    }
+
+public:
+    // Keeps retireFront from freeing any chunk while held. Each thread
+    // counts on its own cache line, so pinning costs no contention.
+    class Pin {
+    private:
+        atomic<int>& pins;
+
+    public:
+        explicit Pin(ChunkedStore& store) : pins(store.pinCount()) {
+            pins.fetch_add(1, memory_order_seq_cst); // Before any chunk pointer is loaded
+        }
+        ~Pin() { pins.fetch_sub(1, memory_order_release); }
+        Pin(const Pin&) = delete;
+        Pin& operator=(const Pin&) = delete;
+    };
+
+    ChunkedStore() = default;
+    ChunkedStore(const ChunkedStore&) = delete;
+    ChunkedStore& operator=(const ChunkedStore&) = delete;
+
+    ~ChunkedStore() {
+        for (int c = 0; c < CHUNK_COUNT; c++) {
+            delete chunks[c].load(memory_order_relaxed);
+        }
+    }
+
+    Pin pin() { return Pin(*this); }
+
+    // Slot i, which must have been claimed and not retired
+    T& operator[](int i) {
+        return chunks[(i / CHUNK_SIZE) % CHUNK_COUNT].load(memory_order_acquire)->slots[i % CHUNK_SIZE];
+    }
+
+    // Slot i if its chunk exists and is not retired, otherwise nullptr
+    T* find(int i) {
+        if (i < firstLive.load(memory_order_acquire) || i >= size()) {
+            return nullptr;
+        }
+        int c = i / CHUNK_SIZE;
+        Chunk* chunk = chunks[c % CHUNK_COUNT].load(memory_order_seq_cst); // Ordered after the Pin
+        return chunk && chunk->number == c ? &chunk->slots[i % CHUNK_SIZE] : nullptr;
+    }
+
+    // Slots claimed so far, retired ones included
+    int size() const { return count.load(memory_order_acquire); }
+    // First slot not retired
+    int liveBegin() const { return firstLive.load(memory_order_acquire); }
+
+    // Claim the next slot for the caller to fill; -1 once full
+    int claim() { return claimRange(1); }
+
+    // Claim n consecutive slots in one step; returns the first or -1
+    int claimRange(int n) {
+        int first = count.load(memory_order_relaxed);
+        do {
+            if (n <= 0 || first > INT32_MAX - n ||
+                (int64_t)first + n > (int64_t)firstLive.load(memory_order_acquire) + CAPACITY) {
+                return -1;
+            }
+        } while (!count.compare_exchange_weak(first, first + n, memory_order_acq_rel, memory_order_relaxed));
+        for (int c = first / CHUNK_SIZE; c <= (first + n - 1) / CHUNK_SIZE; c++) {
+            installChunk(c);
+        }
+        return first;
+    }
+
+    // Make slots [0, n) available, as far as the live window reaches;
+    // for single-threaded startup only
+    void growTo(int n) {
+        int begin = firstLive.load(memory_order_relaxed);
+        n = (int)min<int64_t>(n, (int64_t)begin + CAPACITY);
+        for (int c = begin / CHUNK_SIZE; c <= (n - 1) / CHUNK_SIZE; c++) {
+            installChunk(c);
+        }
+        if (count.load(memory_order_relaxed) < n) {
+            count.store(n, memory_order_release);
+        }
+    }
+
+    // Treat slots [0, n) as retired, n rounded down to a chunk; for
+    // single-threaded startup only, before any slot is used
+    void skipTo(int n) {
+        n -= n % CHUNK_SIZE;
+        firstLive.store(n, memory_order_release);
+        if (count.load(memory_order_relaxed) < n) {
+            count.store(n, memory_order_release);
+        }
+    }
+
+    // Free the oldest live chunk, which must be fully claimed, once no
+    // Pin is held. For one retiring thread at a time.
+    void retireFront() {
+        int first = firstLive.load(memory_order_relaxed);
+        atomic<Chunk*>& slot = chunks[(first / CHUNK_SIZE) % CHUNK_COUNT];
+        Chunk* old = slot.load(memory_order_relaxed);
+        slot.store(nullptr, memory_order_seq_cst); // Before claims may reach its ring slot
+        firstLive.store(first + CHUNK_SIZE, memory_order_seq_cst);
+        for (PinCount& p : pinCounts) {
+            while (p.pins.load(memory_order_seq_cst) != 0) {
+                this_thread::yield();
+            }
+        }
+        delete old;
+    }
+
+    // Bytes reserved, including the chunk directory
+    size_t bytesUsed() const {
+        size_t bytes = sizeof(*this);
+        for (int c = 0; c < CHUNK_COUNT; c++) {
+            if (chunks[c].load(memory_order_relaxed)) {
+                bytes += sizeof(Chunk);
+            }
+        }
+        return bytes;
+    }
+};
+
+// Fixed set of worker threads that run submitted tasks
+class ThreadPool {
+private:
+    vector<thread> workers;
+    queue<function<void()>> tasks;
+    mutex queueMutex;
+    condition_variable queueCv;
+    bool stopping = false;
+
+    void workerLoop() {
+        while (true) {
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(queueMutex);
+                queueCv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) {
+                    return;
+                }
+                task = move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+
+public:
+    explicit ThreadPool(unsigned threadCount = thread::hardware_concurrency()) {
+        if (threadCount == 0) {
+            threadCount = 1;
+        }
+        for (unsigned i = 0; i < threadCount; i++) {
+            workers.emplace_back(&ThreadPool::workerLoop, this);
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Finish queued tasks, then stop the workers
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCv.notify_all();
+        for (thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    // Queue a task and get a future for its result
+    template <typename F>
+    auto submit(F&& f) -> future<decltype(f())> {
+        auto task = make_shared<packaged_task<decltype(f())()>>(forward<F>(f));
+        future<decltype(f())> result = task->get_future();
+        {
+            lock_guard<mutex> lock(queueMutex);
+            tasks.emplace([task]() { (*task)(); });
+        }
+        queueCv.notify_one();
+        return result;
+    }
+
+    size_t size() const { return workers.size(); }
+};
+
+// Transaction type
+enum class TransactionType : uint8_t { Deposit, Withdraw, Transfer };
+
+// Transaction status
+enum class ProcessStatus : uint8_t { Pending, Completed, Failed };
+
+const char* toString(TransactionType type) {
+    switch (type) {
+    case TransactionType::Deposit: return "Deposit";
+    case TransactionType::Withdraw: return "Withdraw";
+    case TransactionType::Transfer: return "Transfer";
+    }
+    return "Unknown";
+}
+
+const char* toString(ProcessStatus status) {
+    switch (status) {
+    case ProcessStatus::Pending: return "Pending";
+    case ProcessStatus::Completed: return "Completed";
+    case ProcessStatus::Failed: return "Failed";
+    }
+    return "Unknown";
+}
+
+// Account structure; balance and active flag live in AccountColumns
 struct Account {
     int id;
-    string customerId;
-    double balance;
-    bool active;
-    mutex accMutex; // Mutex for account-level synchronization
+    uint32_t customer; // Handle into CustomerIndex, 0 before it is filled in
+};
+
+// Customer record: the ID string, kept once, and every account opened
+// for the customer in creation order
+struct Customer {
+    string id;
+    vector<int> accounts;
+};
+
+// Interned customer IDs with a customer-to-accounts index. Accounts
+// hold a 4-byte handle instead of their own copy of the string. The
+// lookup table and account lists are sharded by ID hash, so accounts
+// of different customers open in parallel. Records never move once
+// interned, so name() needs no lock.
+class CustomerIndex {
+private:
+    struct alignas(64) Shard {
+        mutex m;
+        unordered_map<string, uint32_t> handles;
+    };
+    ChunkedStore<Customer, MAX_ACCOUNTS> customers; // At most one per account; handle - 1
+    Shard shards[CUSTOMER_SHARDS];
+    const string none;
+
+    Shard& shardOf(const string& id) { return shards[hash<string>()(id) % CUSTOMER_SHARDS]; }
+
+public:
+    // Record accountId under customer id, interning id if it is new;
+    // returns its handle
+    uint32_t addAccount(const string& id, int accountId) {
+        Shard& shard = shardOf(id);
+        lock_guard<mutex> lock(shard.m);
+        auto it = shard.handles.find(id);
+        if (it == shard.handles.end()) {
+            int slot = customers.claim(); // Never full, there are as many slots as accounts
+            customers[slot].id = id;
+            it = shard.handles.emplace(id, (uint32_t)slot + 1).first;
+        }
+        customers[(int)it->second - 1].accounts.push_back(accountId);
+        return it->second;
+    }
+
+    // Customer ID of a handle taken from an account; empty for 0
+    const string& name(uint32_t handle) { return handle ? customers[(int)handle - 1].id : none; }
+
+    // Accounts of customer id in creation order; empty if unknown
+    vector<int> accountsOf(const string& id) {
+        Shard& shard = shardOf(id);
+        lock_guard<mutex> lock(shard.m);
+        auto it = shard.handles.find(id);
+        return it == shard.handles.end() ? vector<int>() : customers[(int)it->second - 1].accounts;
+    }
+
+    int size() const { return customers.size(); }
+
+    // Bytes reserved, not counting ID strings and account lists
+    size_t bytesUsed() const { return customers.bytesUsed() + sizeof(shards); }
+};
+
+// Balance bands for the bank summary, by lower bound in cents. Band 0
+// holds overdrawn accounts, band 1 empty ones, then one band per decade.
+const int BALANCE_BANDS = 8;
+const Money BALANCE_BAND_FLOOR[BALANCE_BANDS] = {
+    INT64_MIN, 0, 1, 100 * 100, 1000 * 100, 10000 * 100, 100000 * 100, 1000000 * 100};
+
+// Totals over the active accounts
+struct BankSummary {
+    int accounts = 0; // Including inactive
+    int active = 0;
+    Money total = 0;
+    Money minBalance = 0;
+    Money maxBalance = 0;
+    int bands[BALANCE_BANDS] = {};
+};
+
+// Four balances processed at once; GCC vector extension, so it maps to
+// whatever SIMD registers the target has (two SSE2 halves by default)
+typedef Money MoneyLanes __attribute__((vector_size(32)));
+const int MONEY_LANES = 4;
+
+// Account balances and active flags stored column-wise, one chunk per
+// CHUNK_SIZE accounts, away from the account records. Column i belongs
+// to the account in accounts[i]. Aggregates scan dense arrays of plain
+// integers MONEY_LANES at a time; the account strings are never touched.
+class AccountColumns {
+private:
+    struct alignas(64) Chunk {
+        Money balance[CHUNK_SIZE];
+        uint8_t active[CHUNK_SIZE];
+    };
+    static const int CHUNK_COUNT = (MAX_ACCOUNTS + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    atomic<Chunk*> chunks[CHUNK_COUNT] = {};
+
+    Chunk& chunkOf(int i) const { return *chunks[i / CHUNK_SIZE].load(memory_order_acquire); }
+
+    // Running totals of a scan, one per lane. Inactive accounts are
+    // masked out, and each band counts the accounts at or above its floor.
+    struct Scan {
+        MoneyLanes active = {};
+        MoneyLanes total = {};
+        MoneyLanes lo = {INT64_MAX, INT64_MAX, INT64_MAX, INT64_MAX};
+        MoneyLanes hi = {INT64_MIN, INT64_MIN, INT64_MIN, INT64_MIN};
+        MoneyLanes atLeast[BALANCE_BANDS] = {};
+    };
+
+    // Fold MONEY_LANES accounts into the scan; comparisons give -1 per
+    // true lane, so masks and counts need no branch
+    static void scanLanes(const Money* balance, const uint8_t* active, Scan& scan) {
+        MoneyLanes b;
+        memcpy(&b, balance, sizeof(b));
+        MoneyLanes on = {-(Money)active[0], -(Money)active[1], -(Money)active[2], -(Money)active[3]};
+        scan.active -= on;
+        scan.total += b & on;
+        MoneyLanes lo = (b & on) | (scan.lo & ~on);
+        MoneyLanes hi = (b & on) | (scan.hi & ~on);
+        scan.lo = lo < scan.lo ? lo : scan.lo;
+        scan.hi = hi > scan.hi ? hi : scan.hi;
+        for (int k = 1; k < BALANCE_BANDS; k++) {
+            scan.atLeast[k] -= (b >= BALANCE_BAND_FLOOR[k]) & on;
+        }
+    }
+
+    // Fold the first n accounts of one chunk into the scan
+    static void scanChunk(const Chunk& c, int n, Scan& scan) {
+        int j = 0;
+        for (; j + MONEY_LANES <= n; j += MONEY_LANES) {
+            scanLanes(&c.balance[j], &c.active[j], scan);
+        }
+        // Pad the tail with inactive accounts
+        if (j < n) {
+            Money balance[MONEY_LANES] = {};
+            uint8_t active[MONEY_LANES] = {};
+            memcpy(balance, &c.balance[j], (n - j) * sizeof(Money));
+            memcpy(active, &c.active[j], n - j);
+            scanLanes(balance, active, scan);
+        }
+    }
+
+public:
+    AccountColumns() = default;
+    AccountColumns(const AccountColumns&) = delete;
+    AccountColumns& operator=(const AccountColumns&) = delete;
+
+    ~AccountColumns() {
+        for (int c = 0; c < CHUNK_COUNT; c++) {
+            delete chunks[c].load(memory_order_relaxed);
+        }
+    }
+
+    // Install the chunk holding column i if nobody has yet
+    void install(int i) {
+        atomic<Chunk*>& slot = chunks[i / CHUNK_SIZE];
+        Chunk* current = slot.load(memory_order_acquire);
+        if (current) {
+            return;
+        }
+        Chunk* fresh = new Chunk();
+        if (!slot.compare_exchange_strong(current, fresh, memory_order_acq_rel)) {
+            delete fresh;
+        }
+    }
+
+    bool installed(int i) const { return chunks[i / CHUNK_SIZE].load(memory_order_acquire) != nullptr; }
+
+    // Columns of account index i, whose chunk must be installed. Accesses
+    // are relaxed atomics, so seqlock readers may load while the writer
+    // holding the stripe stores; on common targets they are plain moves.
+    Money balance(int i) const { return __atomic_load_n(&chunkOf(i).balance[i % CHUNK_SIZE], __ATOMIC_RELAXED); }
+    bool active(int i) const { return __atomic_load_n(&chunkOf(i).active[i % CHUNK_SIZE], __ATOMIC_RELAXED) != 0; }
+    void setBalance(int i, Money value) { __atomic_store_n(&chunkOf(i).balance[i % CHUNK_SIZE], value, __ATOMIC_RELAXED); }
+    void setActive(int i, bool on) { __atomic_store_n(&chunkOf(i).active[i % CHUNK_SIZE], (uint8_t)on, __ATOMIC_RELAXED); }
+
+    // Summarize accounts [0, n); the caller keeps writers out
+    BankSummary summarize(int n) const {
+        Scan scan;
+        for (int c = 0; c * CHUNK_SIZE < n; c++) {
+            const Chunk* chunk = chunks[c].load(memory_order_acquire);
+            if (chunk) {
+                scanChunk(*chunk, min(CHUNK_SIZE, n - c * CHUNK_SIZE), scan);
+            }
+        }
+        BankSummary sum;
+        sum.accounts = n;
+        Money lo = INT64_MAX;
+        Money hi = INT64_MIN;
+        Money atLeast[BALANCE_BANDS] = {};
+        for (int l = 0; l < MONEY_LANES; l++) {
+            sum.active += (int)scan.active[l];
+            sum.total += scan.total[l];
+            lo = min(lo, scan.lo[l]);
+            hi = max(hi, scan.hi[l]);
+            for (int k = 1; k < BALANCE_BANDS; k++) {
+                atLeast[k] += scan.atLeast[k][l];
+            }
+        }
+        if (sum.active > 0) {
+            sum.minBalance = lo;
+            sum.maxBalance = hi;
+        }
+        atLeast[0] = sum.active;
+        for (int k = 0; k < BALANCE_BANDS; k++) {
+            sum.bands[k] = (int)(atLeast[k] - (k + 1 < BALANCE_BANDS ? atLeast[k + 1] : 0));
+        }
+        return sum;
+    }
+
+    size_t bytesUsed() const {
+        size_t bytes = sizeof(*this);
+        for (int c = 0; c < CHUNK_COUNT; c++) {
+            if (chunks[c].load(memory_order_relaxed)) {
+                bytes += sizeof(Chunk);
+            }
+        }
+        return bytes;
+    }
+};
+
+// Account lock padded to its own cache line so stripes don't false-share
+struct alignas(64) AccountLock {
+    mutex m;
+    atomic<uint32_t> seq{0}; // Seqlock over the stripe's balances, odd during a write
+};
+
+// Seqlock write section on one or two stripes, entered with their
+// mutexes held. Sequences are odd while balances change, so lock-free
+// readers (see BankSystem::readBalance) retry instead of seeing a torn
+// update. b may be null or equal to a.
+class StripeWrite {
+private:
+    AccountLock* a;
+    AccountLock* b;
+
+    static void bump(AccountLock* lock, memory_order order) {
+        if (lock) {
+            lock->seq.store(lock->seq.load(memory_order_relaxed) + 1, order);
+        }
+    }
+
+public:
+    explicit StripeWrite(AccountLock* a, AccountLock* b = nullptr) : a(a), b(b == a ? nullptr : b) {
+        bump(this->a, memory_order_relaxed);
+        bump(this->b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release); // Odd sequences land before the stores
+    }
+
+    ~StripeWrite() {
+        bump(a, memory_order_release);
+        bump(b, memory_order_release);
+    }
+
+    StripeWrite(const StripeWrite&) = delete;
+    StripeWrite& operator=(const StripeWrite&) = delete;
+};
+
+// Outcome of running one transaction
+enum class ProcessResult : uint8_t {
+    Completed,
+    NotFound,
+    AlreadyExecuted,
+    AccountNotFound,
+    InvalidAmount,
+    InsufficientFunds,
+    UnknownType,
+    TableFull,
+    SameAccount,
+    BalanceOverflow
+};
+
+const char* toString(ProcessResult result) {
+    switch (result) {
+    case ProcessResult::Completed: return "Completed";
+    case ProcessResult::NotFound: return "Transaction not found";
+    case ProcessResult::AlreadyExecuted: return "Already executed";
+    case ProcessResult::AccountNotFound: return "Account not found";
+    case ProcessResult::InvalidAmount: return "Invalid amount";
+    case ProcessResult::InsufficientFunds: return "Insufficient funds";
+    case ProcessResult::UnknownType: return "Unknown transaction type";
+    case ProcessResult::TableFull: return "Process table full";
+    case ProcessResult::SameAccount: return "Transfer to the same account";
+    case ProcessResult::BalanceOverflow: return "Balance limit exceeded";
+    }
+    return "Unknown";
+}
+
+// Process structure
+struct Process {
+    int tid;         // Transaction ID
+    int aid;         // Account ID
+    TransactionType type; // Transaction type: Deposit/Withdraw/Transfer
+    Money amount;         // Transaction amount in cents
+    ProcessStatus status; // Status: Pending/Completed/Failed
+    ProcessResult result; // Why it ended as it did, once not Pending
+    int toAid = 0;        // Destination account of a Transfer
+};
+
+// Process table entry; ready is set once the record is fully written
+struct ProcessEntry {
+    Process proc;
+    atomic<bool> ready;
+};
+
+// One record of a batch submission
+struct BatchItem {
+    int accountId;
+    TransactionType type;
+    Money amount;
+    int toAccountId; // Transfers only
+    uint64_t key = 0; // Idempotency key from idempotencyKey, 0 for none
+};
+
+// Outcome of one batch item; tid is -1 if the item was never enqueued
+struct BatchResult {
+    int tid;
+    ProcessResult result;
+};
+
+// Hash of a client-supplied idempotency key, scoped to the account it
+// names; never 0. Two keys that collide in 64 bits would be taken for
+// a retry of each other.
+uint64_t idempotencyKey(int accountId, const string& key) {
+    uint64_t h = 14695981039346656037ULL ^ (uint32_t)accountId; // FNV-1a
+    for (unsigned char ch : key) {
+        h = (h ^ ch) * 1099511628211ULL;
+    }
+    return h ? h : 1;
+}
+
+// Recently used idempotency keys and the TID each was given. Each
+// bucket is one cache line holding DEDUPE_WAYS keys and a spin lock,
+// so a lookup touches a single line and holds it for a few loads. A
+// key expires DEDUPE_TTL_S seconds after it was last used; when a
+// bucket is full the least recently used key makes room.
+class DedupeTable {
+private:
+    struct alignas(64) Bucket {
+        atomic<bool> busy{false};
+        uint32_t used[DEDUPE_WAYS]; // Seconds since start at last use
+        int tid[DEDUPE_WAYS];       // 0 until the owner assigns one
+        uint64_t key[DEDUPE_WAYS];  // 0 marks a free way
+    };
+
+    unique_ptr<Bucket[]> buckets;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    atomic<uint64_t> repeats{0};
+
+    Bucket& lock(uint64_t key) {
+        Bucket& b = buckets[(key >> 32 ^ key) & (DEDUPE_BUCKETS - 1)];
+        while (b.busy.exchange(true, memory_order_acquire)) {
+            while (b.busy.load(memory_order_relaxed)) {
+                this_thread::yield(); // The holder may have been preempted
+            }
+        }
+        return b;
+    }
+
+    static void unlock(Bucket& b) { b.busy.store(false, memory_order_release); }
+
+    uint32_t now() const {
+        return (uint32_t)chrono::duration_cast<chrono::seconds>(chrono::steady_clock::now() - start).count();
+    }
+
+public:
+    DedupeTable() : buckets(new Bucket[DEDUPE_BUCKETS]()) {}
+
+    // True if the caller is the first to claim key and must assign it a
+    // TID. Otherwise tid gets the TID of the first submission, or 0 if
+    // that is still being assigned.
+    bool claim(uint64_t key, int& tid) {
+        uint32_t t = now();
+        Bucket& b = lock(key);
+        int victim = -1;
+        bool victimFree = false;
+        for (int w = 0; w < DEDUPE_WAYS; w++) {
+            bool live = b.key[w] != 0 && t - b.used[w] < DEDUPE_TTL_S;
+            if (live && b.key[w] == key) {
+                b.used[w] = t;
+                tid = b.tid[w];
+                unlock(b);
+                repeats.fetch_add(1, memory_order_relaxed);
+                return false;
+            }
+            if (!live) {
+                victim = w;
+                victimFree = true;
+            } else if (!victimFree && b.tid[w] != 0 && (victim < 0 || b.used[w] < b.used[victim])) {
+                victim = w; // Keys still being assigned are never evicted
+            }
+        }
+        if (victim >= 0) { // Else every way is mid-assignment; go unremembered
+            b.key[victim] = key;
+            b.tid[victim] = 0;
+            b.used[victim] = t;
+        }
+        unlock(b);
+        return true;
+    }
+
+    // TID of a live key, 0 while it is being assigned; false if the key
+    // is not remembered
+    bool find(uint64_t key, int& tid) {
+        uint32_t t = now();
+        Bucket& b = lock(key);
+        bool found = false;
+        for (int w = 0; w < DEDUPE_WAYS && !found; w++) {
+            found = b.key[w] == key && t - b.used[w] < DEDUPE_TTL_S;
+            tid = b.tid[w];
+        }
+        unlock(b);
+        return found;
+    }
+
+    // Record the TID of a claimed key; a negative TID forgets the key, so
+    // a retry runs again
+    void assign(uint64_t key, int tid) {
+        Bucket& b = lock(key);
+        for (int w = 0; w < DEDUPE_WAYS; w++) {
+            if (b.key[w] == key) {
+                if (tid < 0) {
+                    b.key[w] = 0;
+                } else {
+                    b.tid[w] = tid;
+                }
+                break;
+            }
+        }
+        unlock(b);
+    }
+
+    uint64_t repeatCount() const { return repeats.load(memory_order_relaxed); }
+    size_t bytesUsed() const { return sizeof(Bucket) * DEDUPE_BUCKETS; }
+};
+
+// Outcome of opening an account
+enum class AccountResult : uint8_t { Created, NegativeBalance, TableFull, CustomerIdTooLong };
+
+// What an event reports
+enum class EventKind : uint8_t {
+    AccountCreated,   // accountId
+    AccountRejected,  // code = AccountResult
+    ProcessCreated,   // tid, accountId, type, amount
+    ProcessRejected,  // code = ProcessResult
+    ProcessExecuted   // tid, accountId, type, code = ProcessResult, amount = new balance
+};
+
+// Fixed-size binary event record
+struct Event {
+    int64_t timeNs;   // steady_clock time when it was published
+    Money amount;
+    int tid;
+    int accountId;
+    EventKind kind;
+    uint8_t code;
+    TransactionType type;
+};
+
+// Bounded multi-producer queue of trivially copyable records; producers
+// and the consumer never block each other
+template <typename T, size_t SIZE>
+class RingBuffer {
+private:
+    static_assert((SIZE & (SIZE - 1)) == 0, "RingBuffer size must be a power of two");
+    struct Cell {
+        atomic<size_t> seq;
+        T value;
+    };
+    Cell cells[SIZE];
+    alignas(64) atomic<size_t> tail{0};
+    alignas(64) atomic<size_t> head{0};
+
+public:
+    RingBuffer() {
+        for (size_t i = 0; i < SIZE; i++) {
+            cells[i].seq.store(i, memory_order_relaxed);
+        }
+    }
+
+    // Returns false if the buffer is full
+    bool push(const T& value) {
+        size_t pos = tail.load(memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & (SIZE - 1)];
+            size_t seq = cell.seq.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.seq.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false if the buffer is empty
+    bool pop(T& value) {
+        size_t pos = head.load(memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & (SIZE - 1)];
+            size_t seq = cell.seq.load(memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.seq.store(pos + SIZE, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(memory_order_relaxed);
+            }
+        }
+    }
+};
+
+// Consumer of drained events
+class EventSink {
+public:
+    virtual ~EventSink() = default;
+    virtual void write(const Event& event) = 0;
+    virtual void flush() {}
+};
+
+// Prints events as the familiar console messages
+class ConsoleSink : public EventSink {
+public:
+    void write(const Event& e) override {
+        switch (e.kind) {
+        case EventKind::AccountCreated:
+            cout << "Account created successfully! Account ID: " << e.accountId << "\n";
+            break;
+        case EventKind::AccountRejected:
+            if ((AccountResult)e.code == AccountResult::NegativeBalance) {
+                cout << "Error: Initial balance cannot be negative.\n";
+            } else if ((AccountResult)e.code == AccountResult::CustomerIdTooLong) {
+                cout << "Error: Customer ID is longer than " << CUSTOMER_ID_MAX << " characters.\n";
+            } else {
+                cout << "Error: Maximum account limit reached.\n";
+            }
+            break;
+        case EventKind::ProcessCreated:
+            cout << "Process created successfully! Transaction ID: " << e.tid << "\n";
+            break;
+        case EventKind::ProcessRejected:
+            cout << "Error: Maximum process limit reached.\n";
+            break;
+        case EventKind::ProcessExecuted:
+            writeExecuted(e);
+            break;
+        }
+    }
+
+    void flush() override { cout.flush(); }
+
+private:
+    void writeExecuted(const Event& e) {
+        bool deposit = e.type == TransactionType::Deposit;
+        bool transfer = e.type == TransactionType::Transfer;
+        switch ((ProcessResult)e.code) {
+        case ProcessResult::Completed:
+            cout << "Transaction " << e.tid
+                 << (deposit ? ": Deposit successful!" : transfer ? ": Transfer successful!" : ": Withdrawal successful!")
+                 << " New balance: " << formatMoney(e.amount) << "\n";
+            break;
+        case ProcessResult::NotFound:
+            cout << "Error: Transaction ID not found.\n";
+            break;
+        case ProcessResult::AlreadyExecuted:
+            cout << "Error: Transaction " << e.tid << " has already been executed.\n";
+            break;
+        case ProcessResult::AccountNotFound:
+            cout << "Error: Account not found for transaction " << e.tid << "\n";
+            break;
+        case ProcessResult::InvalidAmount:
+            if (deposit) {
+                cout << "Error: Invalid deposit amount.\n";
+                break;
+            }
+            if (transfer) {
+                cout << "Error: Invalid transfer amount.\n";
+                break;
+            }
+            cout << "Error: Insufficient funds or invalid withdrawal amount.\n";
+            break;
+        case ProcessResult::InsufficientFunds:
+            cout << (transfer ? "Error: Insufficient funds for transfer.\n"
+                              : "Error: Insufficient funds or invalid withdrawal amount.\n");
+            break;
+        case ProcessResult::UnknownType:
+            cout << "Error: Unknown transaction type.\n";
+            break;
+        case ProcessResult::TableFull:
+            cout << "Error: Maximum process limit reached.\n";
+            break;
+        case ProcessResult::SameAccount:
+            cout << "Error: Cannot transfer to the same account.\n";
+            break;
+        case ProcessResult::BalanceOverflow:
+            cout << "Error: Transaction " << e.tid << " would exceed the largest balance.\n";
+            break;
+        }
+    }
 };
 
-// Process structure
-struct Process {
-    int tid;         // Transaction ID
-    int aid;         // Account ID
-    string type;     // Transaction type: Deposit/Withdraw
-    double amount;   // Transaction amount
-    string status;   // Status: Pending/Completed/Failed
+// Appends raw Event records to a file
+class BinaryFileSink : public EventSink {
+private:
+    FILE* file;
+
+public:
+    explicit BinaryFileSink(const string& path) : file(fopen(path.c_str(), "ab")) {}
+    ~BinaryFileSink() override {
+        if (file) {
+            fclose(file);
+        }
+    }
+    bool isOpen() const { return file != nullptr; }
+    void write(const Event& e) override {
+        if (file) {
+            fwrite(&e, sizeof(e), 1, file);
+        }
+    }
+    void flush() override {
+        if (file) {
+            fflush(file);
+        }
+    }
+};
+
+// Asynchronous event log: operations publish binary events into a ring
+// buffer and a background thread drains them to the registered sinks
+class EventLog {
+private:
+    RingBuffer<Event, EVENT_RING_SIZE> ring;
+    vector<unique_ptr<EventSink>> sinks;
+    mutex sinkMutex; // Held by the drainer while writing, and by addSink
+    atomic<uint64_t> published{0};
+    atomic<uint64_t> drained{0};
+    atomic<bool> stopping{false};
+    thread drainer;
+
+    void drainLoop() {
+        Event event;
+        int idle = 0;
+        while (true) {
+            bool any = false;
+            {
+                lock_guard<mutex> lock(sinkMutex);
+                while (ring.pop(event)) {
+                    for (auto& sink : sinks) {
+                        sink->write(event);
+                    }
+                    drained.fetch_add(1, memory_order_release);
+                    any = true;
+                }
+                if (any) {
+                    for (auto& sink : sinks) {
+                        sink->flush();
+                    }
+                }
+            }
+            if (any) {
+                idle = 0;
+            } else if (stopping.load(memory_order_acquire)) {
+                return;
+            } else if (++idle < 64) {
+                this_thread::yield();
+            } else {
+                this_thread::sleep_for(chrono::microseconds(200));
+            }
+        }
+    }
+
+public:
+    EventLog() : drainer(&EventLog::drainLoop, this) {}
+
+    EventLog(const EventLog&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+
+    // Drain whatever is left, then stop
+    ~EventLog() {
+        flush();
+        stopping.store(true, memory_order_release);
+        drainer.join();
+    }
+
+    void addSink(unique_ptr<EventSink> sink) {
+        lock_guard<mutex> lock(sinkMutex);
+        sinks.push_back(move(sink));
+    }
+
+    // Queue an event; spins only while the ring is full
+    void publish(Event event) {
+        event.timeNs = chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count();
+        published.fetch_add(1, memory_order_relaxed);
+        while (!ring.push(event)) {
+            this_thread::yield();
+        }
+    }
+
+    // Wait until every event published so far has reached the sinks
+    void flush() {
+        uint64_t target = published.load(memory_order_relaxed);
+        while (drained.load(memory_order_acquire) < target) {
+            this_thread::yield();
+        }
+    }
+};
+
+// Latency histogram with HDR-style log-linear buckets: values below
+// 2^HIST_SUB_BITS ns are exact, larger ones fall into 2^HIST_SUB_BITS
+// linear buckets per power of two (about 6% resolution)
+const int HIST_SUB_BITS = 4;
+const int HIST_SUB = 1 << HIST_SUB_BITS;
+const int HIST_MAX_EXP = 40; // ~18 minutes; longer values land in the last bucket
+const int HIST_BUCKETS = (HIST_MAX_EXP - HIST_SUB_BITS + 2) * HIST_SUB;
+
+int histBucket(uint64_t ns) {
+    if (ns < (uint64_t)HIST_SUB) {
+        return (int)ns;
+    }
+    int exp = 63 - __builtin_clzll(ns);
+    if (exp > HIST_MAX_EXP) {
+        return HIST_BUCKETS - 1;
+    }
+    int sub = (int)(ns >> (exp - HIST_SUB_BITS)) & (HIST_SUB - 1);
+    return (exp - HIST_SUB_BITS + 1) * HIST_SUB + sub;
+}
+
+// Highest value that falls into bucket b
+uint64_t histBucketTop(int b) {
+    if (b < HIST_SUB) {
+        return (uint64_t)b;
+    }
+    int exp = b / HIST_SUB - 1 + HIST_SUB_BITS;
+    uint64_t low = (uint64_t)(HIST_SUB + b % HIST_SUB) << (exp - HIST_SUB_BITS);
+    return low + ((uint64_t)1 << (exp - HIST_SUB_BITS)) - 1;
+}
+
+// What the instrumentation measures
+enum class Metric : uint8_t {
+    Create,    // addProcess
+    Execute,   // Applying one transaction, including its lock wait
+    LockWait,  // Acquiring account stripe locks
+    EndToEnd,  // executeProcess from submission until the change is durable
+    COUNT
+};
+
+const char* toString(Metric metric) {
+    switch (metric) {
+    case Metric::Create: return "create";
+    case Metric::Execute: return "execute";
+    case Metric::LockWait: return "lock_wait";
+    case Metric::EndToEnd: return "end_to_end";
+    case Metric::COUNT: break;
+    }
+    return "unknown";
+}
+
+const int METRIC_COUNT = (int)Metric::COUNT;
+const int METRIC_SHARDS = 32;      // Threads beyond this share shards
+const unsigned METRIC_SAMPLE = 16; // Time one in this many operations per thread
+
+// Latency histograms and outcome counters. Each thread records into its
+// own cache-line-aligned shard with relaxed loads and stores, so recording
+// takes no lock and threads don't contend; reports merge the shards.
+// Reading the clock costs about as much as a whole deposit, so only one
+// in METRIC_SAMPLE operations is timed (end_to_end, which includes a
+// journal sync, is timed every time); the outcome counters are exact.
+class Metrics {
+private:
+    struct alignas(64) Shard {
+        atomic<uint64_t> hist[METRIC_COUNT][HIST_BUCKETS] = {};
+        atomic<uint64_t> maxNs[METRIC_COUNT] = {};
+        atomic<uint64_t> completed{0};
+        atomic<uint64_t> failed{0};
+    };
+    Shard shards[METRIC_SHARDS];
+    chrono::steady_clock::time_point started = chrono::steady_clock::now();
+
+    static Shard& local(Shard* shards) {
+        static atomic<int> nextSlot{0};
+        thread_local int slot = nextSlot.fetch_add(1, memory_order_relaxed) % METRIC_SHARDS;
+        return shards[slot];
+    }
+
+    // Owner-only increment; threads sharing a shard may lose a few counts
+    static void bump(atomic<uint64_t>& counter) {
+        counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+
+    // Merged view of one metric
+    struct Summary {
+        uint64_t count = 0;
+        uint64_t maxNs = 0;
+        vector<uint64_t> hist = vector<uint64_t>(HIST_BUCKETS, 0);
+
+        uint64_t percentile(double q) const {
+            if (count == 0) {
+                return 0;
+            }
+            uint64_t rank = (uint64_t)ceil(q * count);
+            uint64_t seen = 0;
+            for (int b = 0; b < HIST_BUCKETS; b++) {
+                seen += hist[b];
+                if (seen >= rank) {
+                    return min(histBucketTop(b), maxNs);
+                }
+            }
+            return maxNs;
+        }
+    };
+
+    Summary summarize(Metric metric) const {
+        Summary s;
+        int m = (int)metric;
+        for (const Shard& shard : shards) {
+            for (int b = 0; b < HIST_BUCKETS; b++) {
+                uint64_t n = shard.hist[m][b].load(memory_order_relaxed);
+                s.hist[b] += n;
+                s.count += n;
+            }
+            s.maxNs = max(s.maxNs, shard.maxNs[m].load(memory_order_relaxed));
+        }
+        return s;
+    }
+
+    uint64_t total(atomic<uint64_t> Shard::*counter) const {
+        uint64_t n = 0;
+        for (const Shard& shard : shards) {
+            n += (shard.*counter).load(memory_order_relaxed);
+        }
+        return n;
+    }
+
+    double elapsedSeconds() const {
+        return chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    }
+
+public:
+    typedef chrono::steady_clock::time_point Stamp;
+
+    // Start time of an operation, or a zero Stamp if it isn't sampled
+    static Stamp start() {
+        thread_local unsigned calls = 0;
+        return calls++ % METRIC_SAMPLE == 0 ? chrono::steady_clock::now() : Stamp();
+    }
+
+    // Record the time since since, unless it is a zero Stamp
+    void record(Metric metric, Stamp since) {
+        if (since == Stamp()) {
+            return;
+        }
+        uint64_t ns = (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - since).count();
+        Shard& shard = local(shards);
+        int m = (int)metric;
+        bump(shard.hist[m][histBucket(ns)]);
+        if (ns > shard.maxNs[m].load(memory_order_relaxed)) {
+            shard.maxNs[m].store(ns, memory_order_relaxed);
+        }
+    }
+
+    void countOutcome(bool completed) {
+        Shard& shard = local(shards);
+        bump(completed ? shard.completed : shard.failed);
+    }
+
+    // Human-readable table, times in microseconds
+    void print(ostream& out) const {
+        double seconds = elapsedSeconds();
+        out << "\nLatency (us) over " << fixed << setprecision(1) << seconds << " s, 1 in "
+            << METRIC_SAMPLE << " operations sampled:" << endl;
+        out << "Operation\tSamples\tp50\tp99\tp999\tMax" << endl;
+        for (int m = 0; m < METRIC_COUNT; m++) {
+            Summary s = summarize((Metric)m);
+            out << toString((Metric)m) << (strlen(toString((Metric)m)) < 8 ? "\t\t" : "\t") << s.count << "\t"
+                << s.percentile(0.50) / 1000.0 << "\t" << s.percentile(0.99) / 1000.0 << "\t"
+                << s.percentile(0.999) / 1000.0 << "\t" << s.maxNs / 1000.0 << endl;
+        }
+        uint64_t completed = total(&Shard::completed);
+        uint64_t failed = total(&Shard::failed);
+        out << "Transactions: " << completed << " completed, " << failed << " failed ("
+            << setprecision(0) << (completed + failed) / seconds << "/sec)" << endl;
+    }
+
+    // Machine-readable CSV, times in nanoseconds
+    bool dump(const string& path) const {
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file) {
+            return false;
+        }
+        double seconds = elapsedSeconds();
+        fprintf(file, "metric,count,per_sec,p50_ns,p99_ns,p999_ns,max_ns\n");
+        for (int m = 0; m < METRIC_COUNT; m++) {
+            Summary s = summarize((Metric)m); // count is samples, per_sec is estimated from them
+            double scale = (Metric)m == Metric::EndToEnd ? 1 : METRIC_SAMPLE;
+            fprintf(file, "%s,%llu,%.1f,%llu,%llu,%llu,%llu\n", toString((Metric)m), (unsigned long long)s.count,
+                    s.count * scale / seconds, (unsigned long long)s.percentile(0.50), (unsigned long long)s.percentile(0.99),
+                    (unsigned long long)s.percentile(0.999), (unsigned long long)s.maxNs);
+        }
+        uint64_t completed = total(&Shard::completed);
+        uint64_t failed = total(&Shard::failed);
+        fprintf(file, "completed,%llu,%.1f,,,,\n", (unsigned long long)completed, completed / seconds);
+        fprintf(file, "failed,%llu,%.1f,,,,\n", (unsigned long long)failed, failed / seconds);
+        return fclose(file) == 0;
+    }
+};
+
+// Journal record kinds
+enum class JournalOp : uint8_t { OpenAccount = 1, AddProcess, ApplyProcess, PrepareHold = 5, ResolveHold };
+
+// Fixed 32-byte journal record header, followed by nameLen bytes of
+// payload: the customer ID for OpenAccount, a TransferPayload for the
+// AddProcess and ApplyProcess records of a Transfer, and the transfer ID
+// for PrepareHold, ResolveHold and the ApplyProcess of a hold's
+// withdrawal or deposit.
+struct JournalRecord {
+    uint32_t checksum;  // FNV-1a of the rest of the record and its name bytes
+    JournalOp op;
+    uint8_t type;       // Transaction type
+    uint8_t status;     // Process status after the operation
+    uint8_t nameLen;
+    int32_t tid;
+    int32_t accountId;
+    Money amount;       // Initial balance or transaction amount
+    Money balance;      // Account balance after the operation
+};
+
+// Destination side of a Transfer journal record
+struct TransferPayload {
+    int32_t toAccountId;
+    int32_t pad;
+    Money toBalance; // Destination balance after an ApplyProcess
+};
+
+uint32_t journalChecksum(const JournalRecord& rec, const char* name) {
+    uint32_t hash = 2166136261u;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&rec);
+    for (size_t i = sizeof(rec.checksum); i < sizeof(rec); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    for (int i = 0; i < rec.nameLen; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Append-only write-ahead journal with group commit. Appends only copy
+// into a memory buffer; a flusher thread writes and fdatasyncs the buffer
+// once GROUP_COMMIT_RECORDS are pending or GROUP_COMMIT_US have passed, so
+// many records share one sync.
+class Journal {
+private:
+    int fd = -1;
+    string buffer;           // Records not yet written
+    uint64_t nextLsn = 1;    // LSN handed to the next append
+    uint64_t bufferedLsn = 0;
+    uint64_t durableLsn = 0; // Everything up to here is on disk
+    bool failed = false;     // A write or sync failed; durableLsn never moves again
+    uint64_t endOffset = 0;  // File offset just past the last appended record
+    bool stopping = false;
+    mutex journalMutex;
+    condition_variable flushCv;   // Wakes the flusher
+    condition_variable durableCv; // Wakes waitDurable callers
+    thread flusher;
+
+    void flushLoop() {
+        string writing;
+        unique_lock<mutex> lock(journalMutex);
+        while (true) {
+            flushCv.wait_for(lock, chrono::microseconds(GROUP_COMMIT_US), [this]() {
+                return stopping || nextLsn - 1 - durableLsn >= (uint64_t)GROUP_COMMIT_RECORDS;
+            });
+            if (buffer.empty()) {
+                if (stopping) {
+                    return;
+                }
+                continue;
+            }
+            writing.swap(buffer);
+            uint64_t batchLsn = bufferedLsn;
+            if (failed) {
+                writing.clear(); // Nothing after the failed batch may reach the file
+                continue;
+            }
+            lock.unlock();
+            size_t done = 0;
+            bool ok = true;
+            while (ok && done < writing.size()) {
+                ssize_t n = ::write(fd, writing.data() + done, writing.size() - done);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                ok = n > 0;
+                done += ok ? (size_t)n : 0;
+            }
+            ok = ok && fdatasync(fd) == 0;
+            if (!ok) {
+                cerr << "Error: Journal write failed: " << strerror(errno) << endl;
+            }
+            writing.clear();
+            lock.lock();
+            if (ok) {
+                durableLsn = batchLsn;
+            } else {
+                failed = true; // The batch is never acknowledged
+            }
+            durableCv.notify_all();
+        }
+    }
+
+public:
+    Journal() = default;
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    ~Journal() {
+        if (fd < 0) {
+            return;
+        }
+        {
+            lock_guard<mutex> lock(journalMutex);
+            stopping = true;
+        }
+        flushCv.notify_one();
+        flusher.join();
+        ::close(fd);
+    }
+
+    // Open for appending; call after replay
+    bool open(const string& path) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        endOffset = (uint64_t)lseek(fd, 0, SEEK_END);
+        flusher = thread(&Journal::flushLoop, this);
+        return true;
+    }
+
+    bool isOpen() const { return fd >= 0; }
+
+    uint64_t lastLsn() {
+        lock_guard<mutex> lock(journalMutex);
+        return bufferedLsn;
+    }
+
+    // Journal size once everything appended so far is written
+    uint64_t size() {
+        lock_guard<mutex> lock(journalMutex);
+        return endOffset;
+    }
+
+    // Buffer a record; returns its LSN for waitDurable
+    uint64_t append(JournalRecord rec, const string& name = string()) {
+        rec.nameLen = (uint8_t)min(name.size(), (size_t)255);
+        rec.checksum = journalChecksum(rec, name.data());
+        lock_guard<mutex> lock(journalMutex);
+        buffer.append(reinterpret_cast<const char*>(&rec), sizeof(rec));
+        buffer.append(name.data(), rec.nameLen);
+        endOffset += sizeof(rec) + rec.nameLen;
+        bufferedLsn = nextLsn++;
+        if (bufferedLsn - durableLsn >= (uint64_t)GROUP_COMMIT_RECORDS) {
+            flushCv.notify_one();
+        }
+        return bufferedLsn;
+    }
+
+    // Block until the record with this LSN has been synced; false if it
+    // never will be because a write or sync failed
+    bool waitDurable(uint64_t lsn) {
+        unique_lock<mutex> lock(journalMutex);
+        durableCv.wait(lock, [this, lsn]() { return durableLsn >= lsn || failed; });
+        return durableLsn >= lsn;
+    }
+
+    // Apply every intact record in path from byte offset from onwards and
+    // return how many there were. A torn tail from a crash is cut off so new
+    // appends follow the last good record.
+    static long replay(const string& path, const function<void(const JournalRecord&, const string&)>& apply,
+                       long from = 0) {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) {
+            return 0;
+        }
+        fseek(file, 0, SEEK_END);
+        if (ftell(file) < from) {
+            cerr << "Error: Journal " << path << " is shorter than the snapshot expects, not replaying it" << endl;
+            fclose(file);
+            return 0;
+        }
+        fseek(file, from, SEEK_SET);
+        JournalRecord rec;
+        char name[256];
+        long count = 0;
+        long good = from;
+        while (fread(&rec, sizeof(rec), 1, file) == 1) {
+            if (rec.nameLen > 0 && fread(name, rec.nameLen, 1, file) != 1) {
+                break;
+            }
+            if (rec.checksum != journalChecksum(rec, name)) {
+                break;
+            }
+            apply(rec, string(name, rec.nameLen));
+            good = ftell(file);
+            count++;
+        }
+        fseek(file, 0, SEEK_END);
+        bool torn = ftell(file) > good;
+        fclose(file);
+        if (torn && truncate(path.c_str(), good) != 0) {
+            cerr << "Error: Cannot trim journal " << path << endl;
+        }
+        return count;
+    }
+};
+
+// Snapshot file layout: a header, accountCount account rows, processCount
+// process rows, holdCount hold rows, then nameBytes of customer IDs. Every part is fixed-size
+// and trivially copyable so a snapshot can be mmapped and copied in as is.
+const uint32_t SNAPSHOT_MAGIC = 0x50534B42; // "BKSP"
+const uint32_t SNAPSHOT_VERSION = 3;
+
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    int32_t accountCount;
+    int32_t processCount;
+    uint64_t journalOffset; // Journal records before this are in the snapshot
+    uint64_t nameBytes;
+    int32_t holdCount;
+    int32_t pad;
+};
+
+struct SnapshotAccount {
+    Money balance;
+    int32_t id;         // 0 for a slot that was still being filled
+    uint32_t nameOffset;
+    uint8_t nameLen;
+    uint8_t active;
+    uint8_t pad[6];
+};
+
+struct SnapshotProcess {
+    Money amount;
+    int32_t tid;
+    int32_t aid;
+    int32_t toAid;
+    uint8_t type;
+    uint8_t status;
+    uint8_t result; // ProcessResult; 0 (Completed) in older snapshots
+    uint8_t pad;
+};
+
+// Prepared half of a two-phase transfer, see BankSystem::prepareHold
+struct SnapshotHold {
+    Money amount;
+    int32_t accountId;
+    uint8_t debit;
+    uint8_t idLen;
+    char id[HOLD_ID_MAX + 1];
+};
+
+static_assert(is_trivially_copyable<SnapshotHeader>::value &&
+              is_trivially_copyable<SnapshotAccount>::value &&
+              is_trivially_copyable<SnapshotProcess>::value &&
+              is_trivially_copyable<SnapshotHold>::value, "snapshot rows are copied as raw bytes");
+
+// Multi-process batches run on a copy of the account book in a POSIX
+// shared-memory segment, which forked workers map. Stripe locks there
+// are process-shared robust mutexes, and each write under a stripe
+// first saves the balance it replaces. When a worker dies holding a
+// stripe, the next process to lock it rolls the unfinished transaction
+// back, and the parent runs it again.
+struct SharedAccount {
+    Money balance;
+    uint8_t active;
+    uint8_t pad[7];
+};
+
+struct SharedProcess {
+    Money amount;
+    Money balance;   // Source balance once it ran
+    Money toBalance; // Destination balance once a Transfer ran
+    int32_t aid;
+    int32_t toAid;
+    int32_t order;   // Position among applied processes, for the journal
+    uint8_t type;
+    uint8_t status;  // ProcessStatus; leaving Pending commits the transaction
+    uint8_t result;  // ProcessResult
+    uint8_t pad;
+};
+
+// Stripe lock with its undo record
+struct alignas(64) SharedStripe {
+    pthread_mutex_t m;
+    int32_t process;   // Index + 1 of the process writing under it, 0 if none
+    int32_t count;
+    int32_t account[2]; // Account indexes it changed on this stripe
+    Money before[2];    // and their balances before
+};
+
+struct SharedHeader {
+    atomic<int> next;    // Next process to claim
+    atomic<int> applied; // Processes applied so far
+    int32_t accountCount;
+    int32_t processCount;
+    SharedStripe stripes[LOCK_STRIPES];
+};
+
+static_assert(atomic<int>::is_always_lock_free, "shared counters must not need a process-local lock");
+
+class SharedBook {
+private:
+    void* map = MAP_FAILED;
+    size_t mapBytes = 0;
+    SharedHeader* header = nullptr;
+    SharedAccount* accounts = nullptr;
+    SharedProcess* processes = nullptr;
+
+    SharedStripe& stripe(int accountId) { return header->stripes[(unsigned)accountId % LOCK_STRIPES]; }
+
+    // Lock a stripe; if its owner died, undo the owner's unfinished write
+    void lock(SharedStripe& s) {
+        if (pthread_mutex_lock(&s.m) != EOWNERDEAD) {
+            return;
+        }
+        if (s.process && processes[s.process - 1].status == (uint8_t)ProcessStatus::Pending) {
+            for (int k = s.count - 1; k >= 0; k--) {
+                accounts[s.account[k]].balance = s.before[k];
+            }
+        }
+        s.process = 0;
+        s.count = 0;
+        pthread_mutex_consistent(&s.m);
+    }
+
+    // Set an account's balance for process p, saving the old one first.
+    // The signal fences keep the compiler from moving the stores across
+    // each other, so a worker killed at any point leaves a usable record.
+    void write(int p, int accountId, Money balance) {
+        SharedStripe& s = stripe(accountId);
+        SharedAccount& acc = accounts[accountId - 1];
+        s.process = p + 1;
+        s.account[s.count] = accountId - 1;
+        s.before[s.count] = acc.balance;
+        atomic_signal_fence(memory_order_seq_cst);
+        s.count++;
+        atomic_signal_fence(memory_order_seq_cst);
+        acc.balance = balance;
+    }
+
+    bool valid(int accountId) const {
+        return accountId >= 1 && accountId <= header->accountCount && accounts[accountId - 1].active;
+    }
+
+    // Apply process p; its stripes are held
+    ProcessResult settle(int p, SharedProcess& proc) {
+        if (!valid(proc.aid)) {
+            return ProcessResult::AccountNotFound;
+        }
+        if (proc.amount <= 0) {
+            return ProcessResult::InvalidAmount;
+        }
+        Money balance = accounts[proc.aid - 1].balance;
+        switch ((TransactionType)proc.type) {
+        case TransactionType::Deposit:
+            if (balance > INT64_MAX - proc.amount) {
+                return ProcessResult::BalanceOverflow;
+            }
+            write(p, proc.aid, balance + proc.amount);
+            break;
+        case TransactionType::Withdraw:
+            if (balance < proc.amount) {
+                return ProcessResult::InsufficientFunds;
+            }
+            write(p, proc.aid, balance - proc.amount);
+            break;
+        case TransactionType::Transfer:
+            if (!valid(proc.toAid)) {
+                return ProcessResult::AccountNotFound;
+            }
+            if (proc.toAid == proc.aid) {
+                return ProcessResult::SameAccount;
+            }
+            if (balance < proc.amount) {
+                return ProcessResult::InsufficientFunds;
+            }
+            if (accounts[proc.toAid - 1].balance > INT64_MAX - proc.amount) {
+                return ProcessResult::BalanceOverflow;
+            }
+            write(p, proc.aid, balance - proc.amount);
+            write(p, proc.toAid, accounts[proc.toAid - 1].balance + proc.amount);
+            break;
+        default:
+            return ProcessResult::UnknownType;
+        }
+        return ProcessResult::Completed;
+    }
+
+public:
+    SharedBook() = default;
+    SharedBook(const SharedBook&) = delete;
+    SharedBook& operator=(const SharedBook&) = delete;
+
+    ~SharedBook() {
+        if (map != MAP_FAILED) {
+            for (SharedStripe& s : header->stripes) {
+                pthread_mutex_destroy(&s.m);
+            }
+            munmap(map, mapBytes);
+        }
+    }
+
+    // Map a fresh segment for accountCount accounts and processCount
+    // processes. The name is unlinked at once; forked children keep the
+    // mapping and it goes away with the last of them.
+    bool create(int accountCount, int processCount) {
+        string name = "/banksystem-" + to_string(getpid());
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) {
+            return false;
+        }
+        shm_unlink(name.c_str());
+        mapBytes = sizeof(SharedHeader) + (size_t)accountCount * sizeof(SharedAccount) +
+                   (size_t)processCount * sizeof(SharedProcess);
+        if (ftruncate(fd, (off_t)mapBytes) == 0) {
+            map = mmap(nullptr, mapBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        header = new (map) SharedHeader(); // The segment starts zeroed
+        header->accountCount = accountCount;
+        header->processCount = processCount;
+        accounts = reinterpret_cast<SharedAccount*>(header + 1);
+        processes = reinterpret_cast<SharedProcess*>(accounts + accountCount);
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        for (SharedStripe& s : header->stripes) {
+            pthread_mutex_init(&s.m, &attr);
+        }
+        pthread_mutexattr_destroy(&attr);
+        return true;
+    }
+
+    SharedAccount& account(int i) { return accounts[i]; }
+    SharedProcess& process(int i) { return processes[i]; }
+    bool unclaimed() const { return header->next.load() < header->processCount; }
+
+    // Run process p under its stripes, unless a run before a crash
+    // already committed it
+    void run(int p) {
+        SharedProcess& proc = processes[p];
+        SharedStripe* a = &stripe(proc.aid);
+        SharedStripe* b = proc.type == (uint8_t)TransactionType::Transfer ? &stripe(proc.toAid) : a;
+        if (b < a) {
+            swap(a, b);
+        }
+        lock(*a);
+        if (b != a) {
+            lock(*b);
+        }
+        if (proc.status == (uint8_t)ProcessStatus::Pending) {
+            ProcessResult result = settle(p, proc);
+            if (valid(proc.aid)) {
+                proc.balance = accounts[proc.aid - 1].balance;
+            }
+            if (result == ProcessResult::Completed && proc.type == (uint8_t)TransactionType::Transfer) {
+                proc.toBalance = accounts[proc.toAid - 1].balance;
+            }
+            proc.order = header->applied.fetch_add(1);
+            proc.result = (uint8_t)result;
+            atomic_signal_fence(memory_order_seq_cst);
+            proc.status = (uint8_t)(result == ProcessResult::Completed ? ProcessStatus::Completed : ProcessStatus::Failed);
+            atomic_signal_fence(memory_order_seq_cst);
+        }
+        for (SharedStripe* s : {a, b}) {
+            s->process = 0;
+            s->count = 0;
+        }
+        if (b != a) {
+            pthread_mutex_unlock(&b->m);
+        }
+        pthread_mutex_unlock(&a->m);
+    }
+
+    // Worker body: claim and run processes until none are left
+    void work() {
+        int p;
+        while ((p = header->next.fetch_add(1)) < header->processCount) {
+            run(p);
+        }
+    }
+
+    // Lock and release every stripe, undoing what dead workers left
+    void recover() {
+        for (SharedStripe& s : header->stripes) {
+            lock(s);
+            pthread_mutex_unlock(&s.m);
+        }
+    }
+};
+
+// Archive file layout: blocks of retired processes, each an
+// ArchiveHeader followed by payloadBytes of packed records. A record is
+// a flags byte (type, status and result), then zigzag varints of the
+// account ID as a delta from the previous record's, the amount, and for
+// a Transfer the destination as a delta from the account ID. TIDs are
+// implied: record k of a block has TID firstTid + k.
+const uint32_t ARCHIVE_MAGIC = 0x41534B42; // "BKSA"
+
+struct ArchiveHeader {
+    uint32_t magic;
+    uint32_t checksum; // FNV-1a of the payload
+    int32_t firstTid;
+    int32_t count;
+    int32_t minAid; // Lowest and highest account the block touches
+    int32_t maxAid;
+    uint32_t payloadBytes;
+    uint32_t pad;
+};
+
+static_assert(is_trivially_copyable<ArchiveHeader>::value, "archive headers are written as raw bytes");
+
+uint32_t fnv1a(const string& bytes) {
+    uint32_t h = 2166136261u;
+    for (unsigned char ch : bytes) {
+        h = (h ^ ch) * 16777619u;
+    }
+    return h;
+}
+
+void putVarint(string& out, int64_t value) {
+    uint64_t v = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63); // Zigzag, so small negatives stay short
+    while (v >= 0x80) {
+        out += (char)(v | 0x80);
+        v >>= 7;
+    }
+    out += (char)v;
+}
+
+bool getVarint(const string& in, size_t& pos, int64_t& value) {
+    uint64_t v = 0;
+    for (int shift = 0; pos < in.size() && shift < 64; shift += 7) {
+        unsigned char byte = (unsigned char)in[pos++];
+        v |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            value = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Append-only archive of finished processes retired from memory. Each
+// retirement appends one block and syncs it. The block index stays in
+// memory, so looking up a TID reads one block, and a query by account
+// reads only the blocks whose account range covers it. A torn block at
+// the end, left by a crash mid-append, is cut off on open.
+class ProcessArchive {
+private:
+    struct Block {
+        off_t offset; // Of the payload
+        ArchiveHeader header;
+    };
+
+    int fd = -1;
+    mutable mutex indexMutex; // Guards blocks against a concurrent append
+    vector<Block> blocks;
+    off_t fileEnd = 0;
+
+    static string pack(const Process* procs, int count) {
+        string out;
+        out.reserve((size_t)count * 8);
+        int prevAid = 0;
+        for (int i = 0; i < count; i++) {
+            const Process& p = procs[i];
+            out += (char)((uint8_t)p.type | (uint8_t)p.status << 2 | (uint8_t)p.result << 4);
+            putVarint(out, (int64_t)p.aid - prevAid);
+            putVarint(out, p.amount);
+            if (p.type == TransactionType::Transfer) {
+                putVarint(out, (int64_t)p.toAid - p.aid);
+            }
+            prevAid = p.aid;
+        }
+        return out;
+    }
+
+    // Decode a block; false if the payload is damaged
+    static bool unpack(const ArchiveHeader& header, const string& payload, vector<Process>& procs) {
+        procs.clear();
+        procs.reserve(header.count);
+        size_t pos = 0;
+        int64_t prevAid = 0;
+        for (int i = 0; i < header.count; i++) {
+            if (pos >= payload.size()) {
+                return false;
+            }
+            uint8_t flags = (uint8_t)payload[pos++];
+            Process p{header.firstTid + i, 0, (TransactionType)(flags & 3), 0, (ProcessStatus)(flags >> 2 & 3),
+                      (ProcessResult)(flags >> 4), 0};
+            int64_t delta;
+            if (!getVarint(payload, pos, delta) || !getVarint(payload, pos, p.amount)) {
+                return false;
+            }
+            p.aid = (int)(prevAid += delta);
+            if (p.type == TransactionType::Transfer) {
+                if (!getVarint(payload, pos, delta)) {
+                    return false;
+                }
+                p.toAid = (int)(p.aid + delta);
+            }
+            procs.push_back(p);
+        }
+        return pos == payload.size();
+    }
+
+    bool readPayload(const Block& block, string& payload) const {
+        payload.resize(block.header.payloadBytes);
+        return pread(fd, &payload[0], payload.size(), block.offset) == (ssize_t)payload.size();
+    }
+
+public:
+    ProcessArchive() = default;
+    ProcessArchive(const ProcessArchive&) = delete;
+    ProcessArchive& operator=(const ProcessArchive&) = delete;
+
+    ~ProcessArchive() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    // Open or create the archive at path and index its blocks
+    bool open(const string& path) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        ArchiveHeader header;
+        string payload;
+        while (pread(fd, &header, sizeof(header), fileEnd) == (ssize_t)sizeof(header) &&
+               header.magic == ARCHIVE_MAGIC && header.count > 0 &&
+               (blocks.empty() || header.firstTid == endTid())) {
+            Block block{fileEnd + (off_t)sizeof(header), header};
+            if (!readPayload(block, payload) || fnv1a(payload) != header.checksum) {
+                break;
+            }
+            blocks.push_back(block);
+            fileEnd = block.offset + header.payloadBytes;
+        }
+        return ftruncate(fd, fileEnd) == 0; // Drop a torn tail
+    }
+
+    bool isOpen() const { return fd >= 0; }
+
+    // TID after the last archived one; 1 if the archive is empty
+    int endTid() const {
+        lock_guard<mutex> lock(indexMutex);
+        return blocks.empty() ? 1 : blocks.back().header.firstTid + blocks.back().header.count;
+    }
+
+    size_t bytesUsed() const {
+        lock_guard<mutex> lock(indexMutex);
+        return (size_t)fileEnd;
+    }
+
+    // Append procs, which continue the TIDs already archived, as one
+    // block, and sync it
+    bool append(const Process* procs, int count) {
+        ArchiveHeader header{};
+        header.magic = ARCHIVE_MAGIC;
+        header.firstTid = procs[0].tid;
+        header.count = count;
+        header.minAid = INT32_MAX;
+        header.maxAid = 0;
+        for (int i = 0; i < count; i++) {
+            int low = procs[i].type == TransactionType::Transfer ? min(procs[i].aid, procs[i].toAid) : procs[i].aid;
+            int high = procs[i].type == TransactionType::Transfer ? max(procs[i].aid, procs[i].toAid) : procs[i].aid;
+            header.minAid = min(header.minAid, low);
+            header.maxAid = max(header.maxAid, high);
+        }
+        string payload = pack(procs, count);
+        header.payloadBytes = (uint32_t)payload.size();
+        header.checksum = fnv1a(payload);
+        string bytes(reinterpret_cast<const char*>(&header), sizeof(header));
+        bytes += payload;
+        if (pwrite(fd, bytes.data(), bytes.size(), fileEnd) != (ssize_t)bytes.size() || fdatasync(fd) != 0) {
+            return false;
+        }
+        lock_guard<mutex> lock(indexMutex);
+        blocks.push_back(Block{fileEnd + (off_t)sizeof(header), header});
+        fileEnd += (off_t)bytes.size();
+        return true;
+    }
+
+    // Visit archived processes from fromTid on, in TID order, until visit
+    // returns false; with accountId set, only those that touch it
+    void scan(int fromTid, int accountId, const function<bool(const Process&)>& visit) const {
+        vector<Block> index;
+        {
+            lock_guard<mutex> lock(indexMutex);
+            index = blocks;
+        }
+        auto it = upper_bound(index.begin(), index.end(), fromTid, [](int tid, const Block& b) {
+            return tid < b.header.firstTid;
+        });
+        if (it != index.begin()) {
+            --it;
+        }
+        string payload;
+        vector<Process> procs;
+        for (; it != index.end(); ++it) {
+            const ArchiveHeader& header = it->header;
+            if (header.firstTid + header.count <= fromTid ||
+                (accountId && (accountId < header.minAid || accountId > header.maxAid))) {
+                continue;
+            }
+            if (!readPayload(*it, payload) || !unpack(header, payload, procs)) {
+                cerr << "Error: Archive block at TID " << header.firstTid << " is damaged" << endl;
+                return;
+            }
+            for (const Process& p : procs) {
+                bool touches = !accountId || p.aid == accountId ||
+                               (p.type == TransactionType::Transfer && p.toAid == accountId);
+                if (p.tid >= fromTid && touches && !visit(p)) {
+                    return;
+                }
+            }
+        }
+    }
+
+    // An archived process by TID
+    bool find(int tid, Process& proc) const {
+        bool found = false;
+        scan(tid, 0, [&](const Process& p) {
+            found = p.tid == tid;
+            proc = p;
+            return false;
+        });
+        return found;
+    }
+};
+
+// Banking system. There is no bank-wide lock: account and process slots are
+// claimed lock-free, account ID = slot + 1 and TID = slot + 1, and each
+// account is guarded only by its lock stripe.
+class BankSystem {
+private:
+    ChunkedStore<Account, MAX_ACCOUNTS> accounts;
+    AccountColumns columns; // Balance and active flag of each account
+    CustomerIndex customers;
+    ChunkedStore<ProcessEntry, MAX_PROCESSES> processes;
+    DedupeTable recentKeys; // Idempotency keys of recent batch items
+    AccountLock accountLocks[LOCK_STRIPES]; // Striped account-level locks
+    Metrics metrics;
+    EventLog eventLog; // Outlives the pool so late worker events still drain
+    Journal journal;   // Optional write-ahead journal, see openJournal
+    uint64_t journalStart = 0; // Journal offset the loaded snapshot covers
+    string snapshotPath;       // Periodic snapshot target, see startSnapshots
+    thread snapshotter;
+    mutex snapshotMutex;
+    condition_variable snapshotCv;
+    bool stopSnapshots = false;
+    ProcessArchive archive; // Optional, see openArchive
+    thread archiver;
+    mutex archiveMutex;
+    condition_variable archiveCv;
+    bool stopArchiving = false;
+
+    // Prepared half of a transfer between nodes, see prepareHold
+    struct Hold {
+        int accountId;
+        Money amount;
+        bool debit;
+    };
+    mutex holdsMutex; // Taken under the stripe of the hold's account
+    unordered_map<string, Hold> holds;
+    ThreadPool pool; // Transaction workers, declared last so they stop first
+
+    // holdId ties the record of a non-transfer to a hold, see prepareHold
+    void journalProcess(JournalOp op, const Process& proc, Money balance, Money toBalance = 0,
+                        const string& holdId = string()) {
+        JournalRecord rec{};
+        rec.op = op;
+        rec.type = (uint8_t)proc.type;
+        rec.status = (uint8_t)proc.status;
+        rec.tid = proc.tid;
+        rec.accountId = proc.aid;
+        rec.amount = proc.amount;
+        rec.balance = balance;
+        if (proc.type != TransactionType::Transfer) {
+            journal.append(rec, holdId);
+            return;
+        }
+        TransferPayload payload{proc.toAid, 0, toBalance};
+        journal.append(rec, string(reinterpret_cast<const char*>(&payload), sizeof(payload)));
+    }
+
+    // Rebuild state from one journal record during openJournal
+    void replayRecord(const JournalRecord& rec, const string& name) {
+        switch (rec.op) {
+        case JournalOp::OpenAccount: {
+            if (rec.accountId < 1 || rec.accountId > MAX_ACCOUNTS) {
+                return;
+            }
+            accounts.growTo(rec.accountId);
+            columns.install(rec.accountId - 1);
+            Account& acc = accounts[rec.accountId - 1];
+            acc.id = rec.accountId;
+            acc.customer = customers.addAccount(name, rec.accountId);
+            columns.setBalance(rec.accountId - 1, rec.amount);
+            columns.setActive(rec.accountId - 1, true);
+            break;
+        }
+        case JournalOp::AddProcess: {
+            if (rec.tid - 1 < processes.liveBegin() || rec.tid > processes.liveBegin() + MAX_PROCESSES) {
+                return;
+            }
+            TransferPayload payload{};
+            if ((TransactionType)rec.type == TransactionType::Transfer && name.size() == sizeof(payload)) {
+                memcpy(&payload, name.data(), sizeof(payload));
+            }
+            processes.growTo(rec.tid);
+            ProcessEntry& entry = processes[rec.tid - 1];
+            entry.proc = {rec.tid, rec.accountId, (TransactionType)rec.type, rec.amount, ProcessStatus::Pending,
+                          ProcessResult::Completed, payload.toAccountId};
+            entry.ready.store(true, memory_order_release);
+            break;
+        }
+        case JournalOp::ApplyProcess: {
+            Process* proc = findProcess(rec.tid);
+            if (proc) {
+                proc->status = (ProcessStatus)rec.status;
+            }
+            bool transfer = (TransactionType)rec.type == TransactionType::Transfer;
+            if (!transfer && !name.empty()) {
+                if ((TransactionType)rec.type != TransactionType::Withdraw) {
+                    holds.erase(name); // A credit's deposit or a debit's refund
+                } else if ((ProcessStatus)rec.status == ProcessStatus::Completed) {
+                    holds[name] = Hold{rec.accountId, rec.amount, true};
+                }
+            }
+            if ((ProcessStatus)rec.status != ProcessStatus::Completed) {
+                break;
+            }
+            Account* acc = findAccount(rec.accountId);
+            if (acc) {
+                columns.setBalance(acc->id - 1, rec.balance);
+            }
+            TransferPayload payload;
+            if (transfer && name.size() == sizeof(payload)) {
+                memcpy(&payload, name.data(), sizeof(payload));
+                if (Account* to = findAccount(payload.toAccountId)) {
+                    columns.setBalance(to->id - 1, payload.toBalance);
+                }
+            }
+            break;
+        }
+        case JournalOp::PrepareHold:
+            holds[name] = Hold{rec.accountId, rec.amount, false};
+            break;
+        case JournalOp::ResolveHold:
+            holds.erase(name);
+            break;
+        }
+    }
+
+    // Balance update for applyProcess; to is the destination of a Transfer
+    ProcessResult settleProcess(Process& proc, Account* acc, Account* to) {
+        if (!acc) {
+            return ProcessResult::AccountNotFound;
+        }
+        if (proc.amount <= 0) {
+            return ProcessResult::InvalidAmount;
+        }
+        Money balance = balanceOf(*acc);
+        if (proc.type == TransactionType::Deposit) {
+            if (balance > INT64_MAX - proc.amount) {
+                return ProcessResult::BalanceOverflow;
+            }
+            columns.setBalance(acc->id - 1, balance + proc.amount);
+        } else if (proc.type == TransactionType::Withdraw) {
+            if (balance < proc.amount) {
+                return ProcessResult::InsufficientFunds;
+            }
+            columns.setBalance(acc->id - 1, balance - proc.amount);
+        } else if (proc.type == TransactionType::Transfer) {
+            if (!to) {
+                return ProcessResult::AccountNotFound;
+            }
+            if (to == acc) {
+                return ProcessResult::SameAccount;
+            }
+            if (balance < proc.amount) {
+                return ProcessResult::InsufficientFunds;
+            }
+            if (balanceOf(*to) > INT64_MAX - proc.amount) {
+                return ProcessResult::BalanceOverflow;
+            }
+            columns.setBalance(acc->id - 1, balance - proc.amount);
+            columns.setBalance(to->id - 1, balanceOf(*to) + proc.amount);
+        } else {
+            return ProcessResult::UnknownType;
+        }
+        return ProcessResult::Completed;
+    }
+
+    Money balanceOf(const Account& acc) const { return columns.balance(acc.id - 1); }
+
+    // Start one SharedBook worker and add its PID to pids. The child
+    // touches nothing but the segment and leaves with _exit, so the
+    // threads and buffers it inherited never run or flush.
+    static void forkWorker(SharedBook& book, vector<pid_t>& pids) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            book.work();
+            _exit(0);
+        }
+        if (pid > 0) {
+            pids.push_back(pid);
+        }
+    }
+
+    // Stripe of an account; accounts on the same stripe share its lock
+    AccountLock& stripe(int accountId) {
+        return accountLocks[(unsigned)accountId % LOCK_STRIPES];
+    }
+
+    // Lock guarding an account
+    mutex& accountLock(int accountId) {
+        return stripe(accountId).m;
+    }
+
+    // Lock the stripes of both accounts of a transaction. Stripes are
+    // always taken in array order, so transfers running in opposite
+    // directions can't deadlock; a stripe shared by both is taken once.
+    void lockAccounts(const Process& proc, unique_lock<mutex>& first, unique_lock<mutex>& second) {
+        auto start = Metrics::start();
+        mutex* a = &accountLock(proc.aid);
+        mutex* b = proc.type == TransactionType::Transfer ? &accountLock(proc.toAid) : a;
+        if (b < a) {
+            swap(a, b);
+        }
+        first = unique_lock<mutex>(*a);
+        if (b != a) {
+            second = unique_lock<mutex>(*b);
+        }
+        metrics.record(Metric::LockWait, start);
+    }
+
+    // Publish the outcome of an executed transaction
+    void reportProcess(int tid, ProcessResult result, Money newBalance) {
+        Event event{};
+        event.kind = EventKind::ProcessExecuted;
+        event.tid = tid;
+        event.code = (uint8_t)result;
+        event.amount = newBalance;
+        auto pin = processes.pin();
+        if (Process* proc = findProcess(tid)) {
+            event.accountId = proc->aid;
+            event.type = proc->type;
+        }
+        eventLog.publish(event);
+    }
+
+    // Run a batch's transactions for the accounts in order[begin, end),
+    // which is sorted by account; each account's stripe is locked once.
+    // Transfers are not in order, they need two stripes.
+    void runBatchGroups(const BatchItem* items, const vector<int>& order,
+                        size_t begin, size_t end, vector<BatchResult>& results) {
+        size_t i = begin;
+        while (i < end) {
+            int accountId = items[order[i]].accountId;
+            auto lockStart = Metrics::start();
+            lock_guard<mutex> accLock(accountLock(accountId));
+            metrics.record(Metric::LockWait, lockStart);
+            for (; i < end && items[order[i]].accountId == accountId; i++) {
+                auto start = Metrics::start();
+                BatchResult& result = results[order[i]];
+                result.result = applyProcess(*findProcess(result.tid), nullptr);
+                metrics.record(Metric::Execute, start);
+            }
+        }
+    }
+
+public:
+    // Report events on the console unless consoleEvents is false
+    explicit BankSystem(bool consoleEvents = true) {
+        if (consoleEvents) {
+            eventLog.addSink(unique_ptr<EventSink>(new ConsoleSink()));
+        }
+    }
+
+    ~BankSystem() {
+        if (archiver.joinable()) {
+            {
+                lock_guard<mutex> lock(archiveMutex);
+                stopArchiving = true;
+            }
+            archiveCv.notify_one();
+            archiver.join();
+        }
+        if (snapshotter.joinable()) {
+            {
+                lock_guard<mutex> lock(snapshotMutex);
+                stopSnapshots = true;
+            }
+            snapshotCv.notify_one();
+            snapshotter.join();
+        }
+    }
+
+    EventLog& events() { return eventLog; }
+    const Metrics& stats() const { return metrics; }
+
+    // Recover state from the journal at path, then journal every change
+    // to it. Call before any other operation; returns false if the file
+    // cannot be opened for appending.
+    bool openJournal(const string& path) {
+        long count = Journal::replay(path, [this](const JournalRecord& rec, const string& name) {
+            replayRecord(rec, name);
+        }, (long)journalStart);
+        if (count > 0) {
+            cout << "Recovered " << count << " journal records from " << path << endl;
+        }
+        return journal.open(path);
+    }
+
+    // Wait until everything journaled so far is on disk. If the journal
+    // can't be written the program stops: the changes are applied in
+    // memory, and the caller must never report them done.
+    void syncJournal() {
+        if (journal.isOpen() && !journal.waitDurable(journal.lastLsn())) {
+            cerr << "Error: Journal is not durable, stopping." << endl;
+            abort();
+        }
+    }
+
+    // Load the snapshot at path so openJournal only replays the journal
+    // after it. Call before openJournal and any other operation; returns
+    // false if there is no valid snapshot.
+    bool loadSnapshot(const string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+            ::close(fd);
+            return false;
+        }
+        size_t fileSize = (size_t)st.st_size;
+        void* map = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        const SnapshotHeader* header = static_cast<const SnapshotHeader*>(map);
+        bool valid = header->magic == SNAPSHOT_MAGIC && header->version == SNAPSHOT_VERSION &&
+                     header->accountCount >= 0 && header->accountCount <= MAX_ACCOUNTS &&
+                     header->processCount >= 0 && header->processCount <= MAX_PROCESSES && header->holdCount >= 0 &&
+                     sizeof(SnapshotHeader) + header->accountCount * sizeof(SnapshotAccount) +
+                         header->processCount * sizeof(SnapshotProcess) + header->holdCount * sizeof(SnapshotHold) +
+                         header->nameBytes == fileSize;
+        if (valid) {
+            const SnapshotAccount* accountRows = reinterpret_cast<const SnapshotAccount*>(header + 1);
+            const SnapshotProcess* processRows = reinterpret_cast<const SnapshotProcess*>(accountRows + header->accountCount);
+            const SnapshotHold* holdRows = reinterpret_cast<const SnapshotHold*>(processRows + header->processCount);
+            const char* names = reinterpret_cast<const char*>(holdRows + header->holdCount);
+            accounts.growTo(header->accountCount);
+            for (int i = 0; i < header->accountCount; i++) {
+                const SnapshotAccount& row = accountRows[i];
+                Account& acc = accounts[i];
+                acc.id = row.id;
+                string name;
+                if (row.nameOffset + row.nameLen <= header->nameBytes) {
+                    name.assign(names + row.nameOffset, row.nameLen);
+                }
+                acc.customer = row.id ? customers.addAccount(name, row.id) : 0;
+                columns.install(i);
+                columns.setBalance(i, row.balance);
+                columns.setActive(i, row.active != 0);
+            }
+            int lastTid = 0;
+            for (int i = 0; i < header->processCount; i++) {
+                lastTid = max(lastTid, processRows[i].tid);
+            }
+            processes.growTo(lastTid);
+            for (int i = 0; i < header->processCount; i++) {
+                const SnapshotProcess& row = processRows[i];
+                ProcessEntry* entry = processes.find(row.tid - 1); // Null if archived since
+                if (row.tid < 1 || !entry) {
+                    continue;
+                }
+                entry->proc = {row.tid, row.aid, (TransactionType)row.type, row.amount, (ProcessStatus)row.status,
+                               (ProcessResult)row.result, row.toAid};
+                entry->ready.store(true, memory_order_release);
+            }
+            for (int i = 0; i < header->holdCount; i++) {
+                const SnapshotHold& row = holdRows[i];
+                holds[string(row.id, min<size_t>(row.idLen, HOLD_ID_MAX))] = Hold{row.accountId, row.amount, row.debit != 0};
+            }
+            journalStart = header->journalOffset;
+            cout << "Loaded snapshot of " << header->accountCount << " accounts and "
+                 << header->processCount << " processes from " << path << endl;
+        } else {
+            cout << "Error: Snapshot " << path << " is damaged, ignoring it" << endl;
+        }
+        munmap(map, fileSize);
+        return valid;
+    }
+
+    // Write a snapshot of all accounts and processes to path, replacing
+    // the previous one only once the new file is on disk
+    bool writeSnapshot(const string& path) {
+        SnapshotHeader header{};
+        header.magic = SNAPSHOT_MAGIC;
+        header.version = SNAPSHOT_VERSION;
+        vector<SnapshotAccount> accountRows;
+        vector<SnapshotProcess> processRows;
+        vector<SnapshotHold> holdRows;
+        string names;
+        {
+            // Every journaled change happens under a stripe, so with all of
+            // them held the tables match the journal up to its current end
+            unique_lock<mutex> locks[LOCK_STRIPES];
+            for (int s = 0; s < LOCK_STRIPES; s++) {
+                locks[s] = unique_lock<mutex>(accountLocks[s].m);
+            }
+            header.journalOffset = journal.isOpen() ? journal.size() : 0;
+            header.accountCount = accounts.size();
+            auto pin = processes.pin();
+            int firstTid = processes.liveBegin() + 1; // Older ones are archived
+            header.processCount = processes.size() - processes.liveBegin();
+            accountRows.resize(header.accountCount);
+            for (int i = 0; i < header.accountCount; i++) {
+                const Account* slot = accounts.find(i);
+                if (!slot || !columns.installed(i)) {
+                    continue; // Claimed but its chunk is not installed yet
+                }
+                const Account& acc = *slot;
+                SnapshotAccount& row = accountRows[i];
+                row.balance = columns.balance(i);
+                row.id = acc.id;
+                row.nameOffset = (uint32_t)names.size();
+                const string& name = customers.name(acc.customer);
+                row.nameLen = (uint8_t)min<size_t>(name.size(), 255);
+                row.active = columns.active(i);
+                names.append(name.data(), row.nameLen);
+            }
+            processRows.resize(header.processCount);
+            for (int i = 0; i < header.processCount; i++) {
+                Process* proc;
+                while (!(proc = findProcess(firstTid + i)) && firstTid + i - 1 >= processes.liveBegin()) {
+                    this_thread::yield(); // addProcess journals before publishing
+                }
+                if (!proc) {
+                    continue; // Archived meanwhile; the row stays empty
+                }
+                SnapshotProcess& row = processRows[i];
+                row.amount = proc->amount;
+                row.tid = proc->tid;
+                row.aid = proc->aid;
+                row.toAid = proc->toAid;
+                row.type = (uint8_t)proc->type;
+                row.status = (uint8_t)proc->status;
+                row.result = (uint8_t)proc->result;
+            }
+            lock_guard<mutex> holdLock(holdsMutex);
+            for (const auto& entry : holds) {
+                SnapshotHold row{};
+                row.amount = entry.second.amount;
+                row.accountId = entry.second.accountId;
+                row.debit = entry.second.debit;
+                row.idLen = (uint8_t)entry.first.size(); // prepareHold keeps IDs to HOLD_ID_MAX
+                memcpy(row.id, entry.first.data(), row.idLen);
+                holdRows.push_back(row);
+            }
+            header.holdCount = (int32_t)holdRows.size();
+        }
+        header.nameBytes = names.size();
+        syncJournal(); // The journal must reach journalOffset before the snapshot counts
+
+        string tmpPath = path + ".tmp";
+        FILE* file = fopen(tmpPath.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  fwrite(accountRows.data(), sizeof(SnapshotAccount), accountRows.size(), file) == accountRows.size() &&
+                  fwrite(processRows.data(), sizeof(SnapshotProcess), processRows.size(), file) == processRows.size() &&
+                  fwrite(holdRows.data(), sizeof(SnapshotHold), holdRows.size(), file) == holdRows.size() &&
+                  fwrite(names.data(), 1, names.size(), file) == names.size() &&
+                  fflush(file) == 0 && fsync(fileno(file)) == 0;
+        ok = fclose(file) == 0 && ok;
+        if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+            remove(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Write a snapshot to path every SNAPSHOT_INTERVAL_S seconds until the
+    // bank is destroyed
+    void startSnapshots(const string& path) {
+        snapshotPath = path;
+        snapshotter = thread([this]() {
+            unique_lock<mutex> lock(snapshotMutex);
+            while (!snapshotCv.wait_for(lock, chrono::seconds(SNAPSHOT_INTERVAL_S), [this]() { return stopSnapshots; })) {
+                lock.unlock();
+                if (!writeSnapshot(snapshotPath)) {
+                    cerr << "Error: Cannot write snapshot " << snapshotPath << endl;
+                }
+                lock.lock();
+            }
+        });
+    }
+
+    const string& snapshotFile() const { return snapshotPath; }
+
+    // Keep retired processes in the archive at path; processes it
+    // already holds are not loaded again. Call before loadSnapshot and
+    // openJournal.
+    bool openArchive(const string& path) {
+        if (!archive.open(path)) {
+            return false;
+        }
+        processes.skipTo(archive.endTid() - 1);
+        return true;
+    }
+
+    // Move finished processes to the archive, a chunk at a time and oldest
+    // first, while more than PROCESS_HOT_CHUNKS chunks are in memory. A
+    // chunk is copied out under all stripes, written and synced, and only
+    // then freed, so every process is always in one place or the other.
+    // Stops at a chunk with a transaction still pending. Returns the
+    // number of processes retired.
+    int retireProcesses() {
+        int retired = 0;
+        vector<Process> chunk(CHUNK_SIZE);
+        while (archive.isOpen() && processes.size() - processes.liveBegin() > PROCESS_HOT_CHUNKS * CHUNK_SIZE) {
+            int firstTid = processes.liveBegin() + 1;
+            {
+                unique_lock<mutex> locks[LOCK_STRIPES];
+                for (int s = 0; s < LOCK_STRIPES; s++) {
+                    locks[s] = unique_lock<mutex>(accountLocks[s].m);
+                }
+                for (int k = 0; k < CHUNK_SIZE; k++) {
+                    Process* proc = findProcess(firstTid + k);
+                    if (!proc || proc->status == ProcessStatus::Pending) {
+                        return retired; // A finished status never changes, so the copy stays true
+                    }
+                    chunk[k] = *proc;
+                }
+            }
+            if (!archive.append(chunk.data(), CHUNK_SIZE)) {
+                cerr << "Error: Cannot write the process archive" << endl;
+                return retired;
+            }
+            processes.retireFront();
+            retired += CHUNK_SIZE;
+        }
+        return retired;
+    }
+
+    // Retire processes every ARCHIVE_INTERVAL_MS until the bank is
+    // destroyed; needs openArchive
+    void startArchiving() {
+        archiver = thread([this]() {
+            unique_lock<mutex> lock(archiveMutex);
+            while (!archiveCv.wait_for(lock, chrono::milliseconds(ARCHIVE_INTERVAL_MS), [this]() { return stopArchiving; })) {
+                lock.unlock();
+                retireProcesses();
+                lock.lock();
+            }
+        });
+    }
+
+    // Add an account without printing; returns its ID, or -1 when full or
+    // customerId is longer than CUSTOMER_ID_MAX
+    int addAccount(const string& customerId, Money initialBalance) {
+        if (customerId.size() > CUSTOMER_ID_MAX) {
+            return -1;
+        }
+        int slot = accounts.claim();
+        if (slot < 0) {
+            return -1;
+        }
+        int accountId = slot + 1;
+        columns.install(slot);
+        lock_guard<mutex> lock(accountLock(accountId)); // Publishes the record
+        Account& acc = accounts[slot];
+        acc.id = accountId;
+        StripeWrite write(&stripe(accountId));
+        columns.setBalance(slot, initialBalance);
+        columns.setActive(slot, true);
+        acc.customer = customers.addAccount(customerId, accountId); // Listers lock the stripe, so see it whole
+        if (journal.isOpen()) {
+            JournalRecord rec{};
+            rec.op = JournalOp::OpenAccount;
+            rec.accountId = accountId;
+            rec.amount = initialBalance;
+            rec.balance = initialBalance;
+            journal.append(rec, customerId);
+        }
+        return accountId;
+    }
+
+    // Create an account
+    int createAccount(const string& customerId, Money initialBalance) {
+        Event event{};
+        int accountId = -1;
+        if (initialBalance < 0) {
+            event.kind = EventKind::AccountRejected;
+            event.code = (uint8_t)AccountResult::NegativeBalance;
+        } else if (customerId.size() > CUSTOMER_ID_MAX) {
+            event.kind = EventKind::AccountRejected;
+            event.code = (uint8_t)AccountResult::CustomerIdTooLong;
+        } else if ((accountId = addAccount(customerId, initialBalance)) == -1) {
+            event.kind = EventKind::AccountRejected;
+            event.code = (uint8_t)AccountResult::TableFull;
+        } else {
+            event.kind = EventKind::AccountCreated;
+            event.accountId = accountId;
+            event.amount = initialBalance;
+            syncJournal();
+        }
+        eventLog.publish(event);
+        return accountId;
+    }
+
+    // Add a transaction without printing; returns its TID or -1 when full.
+    // toAccountId is the destination of a Transfer.
+    int addProcess(int accountId, TransactionType type, Money amount, int toAccountId = 0) {
+        auto start = Metrics::start();
+        int slot = processes.claim();
+        if (slot < 0) {
+            return -1;
+        }
+        int tid = slot + 1;
+        ProcessEntry& entry = processes[slot];
+        entry.proc = {tid, accountId, type, amount, ProcessStatus::Pending, ProcessResult::Completed, toAccountId};
+        if (journal.isOpen()) {
+            journalProcess(JournalOp::AddProcess, entry.proc, 0); // Before it can run
+        }
+        entry.ready.store(true, memory_order_release);
+        metrics.record(Metric::Create, start);
+        return tid;
+    }
+
+    // Create a transaction process
+    int createProcess(int accountId, TransactionType type, Money amount, int toAccountId = 0) {
+        int tid = addProcess(accountId, type, amount, toAccountId);
+        Event event{};
+        event.accountId = accountId;
+        event.type = type;
+        event.amount = amount;
+        if (tid == -1) {
+            event.kind = EventKind::ProcessRejected;
+            event.code = (uint8_t)ProcessResult::TableFull;
+        } else {
+            event.kind = EventKind::ProcessCreated;
+            event.tid = tid;
+            syncJournal();
+        }
+        eventLog.publish(event);
+        return tid;
+    }
+
+    // Execute a transaction process on the worker pool
+    future<bool> executeProcess(int tid) {
+        auto submitted = chrono::steady_clock::now(); // Always timed, it waits for a sync anyway
+        return pool.submit([this, tid, submitted]() {
+            Money newBalance = 0;
+            ProcessResult result = runProcess(tid, &newBalance);
+            syncJournal(); // Acknowledge only once the change is durable
+            metrics.record(Metric::EndToEnd, submitted);
+            reportProcess(tid, result, newBalance);
+            return result == ProcessResult::Completed;
+        });
+    }
+
+    // Run one transaction under its accounts' locks only
+    ProcessResult runProcess(int tid, Money* newBalance = nullptr) {
+        auto pin = processes.pin();
+        Process* procPtr = findProcess(tid);
+        if (!procPtr) {
+            return tid >= 1 && tid - 1 < processes.liveBegin() ? ProcessResult::AlreadyExecuted // Archived
+                                                               : ProcessResult::NotFound;
+        }
+        Process& proc = *procPtr;
+
+        // Synchronize account operations
+        auto start = Metrics::start();
+        unique_lock<mutex> first, second;
+        lockAccounts(proc, first, second);
+        ProcessResult result = applyProcess(proc, newBalance);
+        metrics.record(Metric::Execute, start);
+        return result;
+    }
+
+    // Apply a transaction and journal the outcome; the caller must hold
+    // the stripe locks of its accounts. newBalance gets the balance of
+    // the (source) account. holdId is journaled with it, see prepareHold.
+    ProcessResult applyProcess(Process& proc, Money* newBalance, const string& holdId = string()) {
+        if (proc.status != ProcessStatus::Pending) {
+            return ProcessResult::AlreadyExecuted;
+        }
+        Account* acc = findAccount(proc.aid);
+        Account* to = proc.type == TransactionType::Transfer ? findAccount(proc.toAid) : nullptr;
+        ProcessResult result;
+        {
+            StripeWrite write(&stripe(proc.aid), to ? &stripe(proc.toAid) : nullptr);
+            result = settleProcess(proc, acc, to);
+        }
+        proc.status = result == ProcessResult::Completed ? ProcessStatus::Completed : ProcessStatus::Failed;
+        proc.result = result;
+        metrics.countOutcome(result == ProcessResult::Completed);
+        if (journal.isOpen()) {
+            journalProcess(JournalOp::ApplyProcess, proc, acc ? balanceOf(*acc) : 0, to ? balanceOf(*to) : 0, holdId);
+        }
+        if (newBalance && acc) {
+            *newBalance = balanceOf(*acc);
+        }
+        return result;
+    }
+
+    // Prepare half id of a transfer between nodes. A debit withdraws
+    // amount now and holds it, so committing can't fail; a credit only
+    // checks the account. The hold is journaled in the same record as
+    // the change it makes, and snapshotted, so it survives a restart.
+    // AlreadyExecuted if id is prepared already.
+    ProcessResult prepareHold(const string& id, int accountId, Money amount, bool debit) {
+        if (amount <= 0) {
+            return ProcessResult::InvalidAmount;
+        }
+        if (id.empty() || id.size() > HOLD_ID_MAX) {
+            return ProcessResult::NotFound;
+        }
+        lock_guard<mutex> lock(accountLock(accountId));
+        lock_guard<mutex> holdLock(holdsMutex);
+        if (holds.count(id)) {
+            return ProcessResult::AlreadyExecuted;
+        }
+        if (debit) {
+            int tid = addProcess(accountId, TransactionType::Withdraw, amount);
+            if (tid < 0) {
+                return ProcessResult::TableFull;
+            }
+            auto pin = processes.pin();
+            ProcessResult result = applyProcess(*findProcess(tid), nullptr, id);
+            if (result != ProcessResult::Completed) {
+                return result;
+            }
+        } else {
+            Account* acc = findAccount(accountId);
+            if (!acc) {
+                return ProcessResult::AccountNotFound;
+            }
+            if (balanceOf(*acc) > INT64_MAX - amount) {
+                return ProcessResult::BalanceOverflow; // Checked again when the credit commits
+            }
+            if (journal.isOpen()) {
+                JournalRecord rec{};
+                rec.op = JournalOp::PrepareHold;
+                rec.accountId = accountId;
+                rec.amount = amount;
+                journal.append(rec, id);
+            }
+        }
+        holds[id] = Hold{accountId, amount, debit};
+        return ProcessResult::Completed;
+    }
+
+    // Commit or abort the prepared half id. Committing a credit deposits
+    // it and aborting a debit pays it back; the other two only drop the
+    // hold. NotFound if id is not prepared here.
+    ProcessResult resolveHold(const string& id, bool commit) {
+        int accountId;
+        {
+            lock_guard<mutex> holdLock(holdsMutex);
+            auto it = holds.find(id);
+            if (it == holds.end()) {
+                return ProcessResult::NotFound;
+            }
+            accountId = it->second.accountId;
+        }
+        lock_guard<mutex> lock(accountLock(accountId));
+        lock_guard<mutex> holdLock(holdsMutex);
+        auto it = holds.find(id);
+        if (it == holds.end()) {
+            return ProcessResult::NotFound; // Resolved meanwhile
+        }
+        Hold hold = it->second;
+        if (commit != hold.debit) {
+            int tid = addProcess(hold.accountId, TransactionType::Deposit, hold.amount);
+            if (tid < 0) {
+                return ProcessResult::TableFull; // Still held, the caller can try again
+            }
+            holds.erase(it);
+            auto pin = processes.pin();
+            return applyProcess(*findProcess(tid), nullptr, id);
+        }
+        holds.erase(it);
+        if (journal.isOpen()) {
+            JournalRecord rec{};
+            rec.op = JournalOp::ResolveHold;
+            rec.accountId = hold.accountId;
+            rec.amount = hold.amount;
+            journal.append(rec, id);
+        }
+        return ProcessResult::Completed;
+    }
+
+    // Answer a batch item whose key was claimed before, here or by an
+    // earlier submission: the TID and outcome of that submission, once
+    // it has run. Must be called only after this batch's own items ran,
+    // so two batches never wait on each other.
+    BatchResult repeatResult(uint64_t key) {
+        int tid = 0;
+        while (recentKeys.find(key, tid)) {
+            Process archived;
+            if (tid && tid - 1 < processes.liveBegin() && archive.find(tid, archived)) {
+                return BatchResult{tid, archived.result};
+            }
+            {
+                auto pin = processes.pin();
+                Process* proc = tid ? findProcess(tid) : nullptr;
+                if (proc) {
+                    lock_guard<mutex> lock(accountLock(proc->aid)); // Status is written under it
+                    if (proc->status != ProcessStatus::Pending) {
+                        return BatchResult{tid, proc->result};
+                    }
+                }
+            }
+            this_thread::yield(); // The first submission has not run yet
+        }
+        return BatchResult{-1, ProcessResult::TableFull};
+    }
+
+    // Submit and run a batch of transactions without printing. All slots
+    // are claimed in one step, then the batch runs on the pool grouped by
+    // account, and transfers run after the grouped pass. results[i]
+    // belongs to items[i]. An item with a key that was used within
+    // DEDUPE_TTL_S, in this batch or an earlier one, is not run again:
+    // it gets the TID and outcome of the first. Must not be called from
+    // a pool worker.
+    vector<BatchResult> submitBatch(const BatchItem* items, int count) {
+        vector<BatchResult> results(count, BatchResult{-1, ProcessResult::Completed});
+        vector<int> order;
+        vector<int> repeats;
+        order.reserve(count);
+        for (int i = 0; i < count; i++) {
+            int tid;
+            if (items[i].amount <= 0) {
+                results[i].result = ProcessResult::InvalidAmount;
+            } else if (items[i].key && !recentKeys.claim(items[i].key, tid)) {
+                repeats.push_back(i);
+            } else {
+                order.push_back(i);
+            }
+        }
+        if (order.empty()) {
+            for (int i : repeats) {
+                results[i] = repeatResult(items[i].key);
+            }
+            return results;
+        }
+
+        int first = processes.claimRange((int)order.size());
+        if (first < 0) {
+            for (int i : order) {
+                results[i].result = ProcessResult::TableFull;
+                if (items[i].key) {
+                    recentKeys.assign(items[i].key, -1);
+                }
+            }
+            for (int i : repeats) {
+                results[i] = repeatResult(items[i].key);
+            }
+            return results;
+        }
+        for (size_t k = 0; k < order.size(); k++) {
+            const BatchItem& item = items[order[k]];
+            ProcessEntry& entry = processes[first + (int)k];
+            entry.proc = {first + (int)k + 1, item.accountId, item.type, item.amount, ProcessStatus::Pending,
+                          ProcessResult::Completed,
+                          item.type == TransactionType::Transfer ? item.toAccountId : 0};
+            if (journal.isOpen()) {
+                journalProcess(JournalOp::AddProcess, entry.proc, 0);
+            }
+            entry.ready.store(true, memory_order_release);
+            results[order[k]].tid = first + (int)k + 1;
+            if (item.key) {
+                recentKeys.assign(item.key, first + (int)k + 1);
+            }
+        }
+
+        // Group by account, keeping submission order within an account
+        vector<int> transfers;
+        order.erase(remove_if(order.begin(), order.end(), [items, &transfers](int i) {
+            if (items[i].type != TransactionType::Transfer) {
+                return false;
+            }
+            transfers.push_back(i);
+            return true;
+        }), order.end());
+        stable_sort(order.begin(), order.end(), [items](int a, int b) {
+            return items[a].accountId < items[b].accountId;
+        });
+
+        // Split into one contiguous range per worker, on account boundaries
+        size_t workers = pool.size();
+        size_t step = (order.size() + workers - 1) / workers;
+        vector<future<void>> done;
+        size_t begin = 0;
+        while (begin < order.size()) {
+            size_t end = min(order.size(), begin + step);
+            while (end < order.size() && items[order[end]].accountId == items[order[end - 1]].accountId) {
+                end++;
+            }
+            done.push_back(pool.submit([this, items, &order, &results, begin, end]() {
+                runBatchGroups(items, order, begin, end, results);
+            }));
+            begin = end;
+        }
+        for (future<void>& f : done) {
+            f.wait();
+        }
+
+        // Transfers take both stripes each, so they spread freely
+        done.clear();
+        step = (transfers.size() + workers - 1) / workers;
+        for (begin = 0; begin < transfers.size(); begin += step) {
+            size_t end = min(transfers.size(), begin + step);
+            done.push_back(pool.submit([this, &transfers, &results, begin, end]() {
+                for (size_t i = begin; i < end; i++) {
+                    BatchResult& result = results[transfers[i]];
+                    result.result = runProcess(result.tid);
+                }
+            }));
+        }
+        for (future<void>& f : done) {
+            f.wait();
+        }
+        for (int i : repeats) {
+            results[i] = repeatResult(items[i].key);
+        }
+        syncJournal();
+        return results;
+    }
+
+    // Run a batch in forked worker processes instead of the thread pool.
+    // Accounts and the batch go into a SharedBook, workers run items in
+    // no set order, and a worker that dies is replaced while work is
+    // left; whatever it left half done is rolled back and rerun. The
+    // final balances and processes are then copied back and journaled
+    // in the order they were applied. The bank is frozen meanwhile.
+    // crashed gets the number of workers lost. Empty if the segment
+    // cannot be created.
+    vector<BatchResult> submitBatchProcesses(const BatchItem* items, int count, int workers, int* crashed = nullptr) {
+        unique_lock<mutex> locks[LOCK_STRIPES];
+        for (int s = 0; s < LOCK_STRIPES; s++) {
+            locks[s] = unique_lock<mutex>(accountLocks[s].m);
+        }
+        int accountCount = accounts.size();
+        SharedBook book;
+        if (count <= 0 || !book.create(accountCount, count)) {
+            return vector<BatchResult>();
+        }
+        for (int i = 0; i < accountCount; i++) {
+            if (accounts.find(i) && columns.installed(i)) {
+                book.account(i).balance = columns.balance(i);
+                book.account(i).active = columns.active(i);
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            SharedProcess& proc = book.process(i);
+            proc.amount = items[i].amount;
+            proc.aid = items[i].accountId;
+            proc.toAid = items[i].type == TransactionType::Transfer ? items[i].toAccountId : 0;
+            proc.type = (uint8_t)items[i].type;
+        }
+
+        cout.flush(); // Children must not inherit unwritten output
+        vector<pid_t> pids;
+        for (int w = 0; w < workers; w++) {
+            forkWorker(book, pids);
+        }
+        // Waits by PID, so children the rest of the program forks are left alone;
+        // the others keep claiming work while one is waited for
+        int lost = 0;
+        for (size_t w = 0; w < pids.size(); w++) {
+            int status;
+            if (waitpid(pids[w], &status, 0) == pids[w] && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+                lost++;
+                if (book.unclaimed()) {
+                    forkWorker(book, pids);
+                }
+            }
+        }
+        book.recover();
+        for (int i = 0; i < count; i++) {
+            if (book.process(i).status == (uint8_t)ProcessStatus::Pending) {
+                book.run(i); // Claimed by a worker that died, or no worker could start
+            }
+        }
+        if (crashed) {
+            *crashed = lost;
+        }
+
+        for (int i = 0; i < accountCount; i++) {
+            if (accounts.find(i) && columns.installed(i) && columns.balance(i) != book.account(i).balance) {
+                StripeWrite write(&stripe(i + 1));
+                columns.setBalance(i, book.account(i).balance);
+            }
+        }
+        vector<BatchResult> results(count, BatchResult{-1, ProcessResult::TableFull});
+        int first = processes.claimRange(count);
+        if (first < 0) {
+            return results; // Balances are in, but there is no room to record the processes
+        }
+        vector<int> applied(count);
+        for (int i = 0; i < count; i++) {
+            const SharedProcess& row = book.process(i);
+            ProcessEntry& entry = processes[first + i];
+            entry.proc = {first + i + 1, row.aid, (TransactionType)row.type, row.amount, ProcessStatus::Pending,
+                          ProcessResult::Completed, row.toAid};
+            if (journal.isOpen()) {
+                journalProcess(JournalOp::AddProcess, entry.proc, 0);
+            }
+            entry.proc.status = (ProcessStatus)row.status;
+            entry.proc.result = (ProcessResult)row.result;
+            entry.ready.store(true, memory_order_release);
+            results[i] = BatchResult{first + i + 1, (ProcessResult)row.result};
+            metrics.countOutcome(results[i].result == ProcessResult::Completed);
+            applied[i] = i;
+        }
+        if (journal.isOpen()) {
+            sort(applied.begin(), applied.end(), [&book](int a, int b) {
+                return book.process(a).order < book.process(b).order;
+            });
+            for (int i : applied) {
+                const SharedProcess& row = book.process(i);
+                journalProcess(JournalOp::ApplyProcess, processes[first + i].proc, row.balance, row.toBalance);
+            }
+        }
+        for (auto& lock : locks) {
+            lock.unlock();
+        }
+        syncJournal();
+        return results;
+    }
+
+    // Find an account by ID; the caller must hold accountLock(accountId)
+    Account* findAccount(int accountId) {
+        Account* acc = accounts.find(accountId - 1);
+        return acc && columns.installed(accountId - 1) && columns.active(accountId - 1) ? acc : nullptr;
+    }
+
+    // Find a published process by transaction ID
+    Process* findProcess(int tid) {
+        ProcessEntry* entry = processes.find(tid - 1);
+        if (!entry || !entry->ready.load(memory_order_acquire)) {
+            return nullptr;
+        }
+        return &entry->proc;
+    }
+
+    // Read an account's balance without its lock, so readers never
+    // block writers or each other. The read is retried while a writer is
+    // inside the stripe's seqlock or has passed through it meanwhile.
+    // Returns false for unknown and closed accounts; a closed account's
+    // balance is still filled in.
+    bool readBalance(int accountId, Money& balance) {
+        int i = accountId - 1;
+        if (!accounts.find(i) || !columns.installed(i)) {
+            return false;
+        }
+        atomic<uint32_t>& seq = stripe(accountId).seq;
+        while (true) {
+            uint32_t before = seq.load(memory_order_acquire);
+            if (before & 1) {
+                this_thread::yield();
+                continue;
+            }
+            Money value = columns.balance(i);
+            bool active = columns.active(i);
+            atomic_thread_fence(memory_order_acquire); // Loads above finish before the recheck
+            if (seq.load(memory_order_relaxed) == before) {
+                balance = value;
+                return active;
+            }
+        }
+    }
+
+    // Check account balance
+    Money checkBalance(int accountId) {
+        Money balance;
+        if (readBalance(accountId, balance)) {
+            return balance;
+        }
+        cout << "Error: Invalid account ID." << endl;
+        return -1;
+    }
+
+    // Display one page of up to PROCESS_PAGE processes from TID fromTid
+    // on, archived ones first; with accountId set, only those that touch
+    // the account. Rows are printed as they are read. Returns the TID the
+    // next page starts at, or 0 after the last process.
+    int printProcesses(int fromTid, int accountId = 0) {
+        cout << "\nProcess Table:" << endl;
+        cout << "TID\tAID\tType\t\tAmount\tStatus" << endl;
+        int shown = 0;
+        int tid = max(fromTid, 1);
+        auto print = [&shown](const Process& proc) {
+            cout << proc.tid << "\t" << proc.aid;
+            if (proc.type == TransactionType::Transfer) {
+                cout << "->" << proc.toAid;
+            }
+            cout << "\t" << toString(proc.type) << "\t\t" << formatMoney(proc.amount) << "\t"
+                 << toString(proc.status) << endl;
+            return ++shown < PROCESS_PAGE;
+        };
+        while (shown < PROCESS_PAGE && tid <= processes.size()) {
+            int liveTid = processes.liveBegin() + 1; // Everything before it is in the archive
+            if (tid < liveTid) {
+                archive.scan(tid, accountId, [&](const Process& proc) {
+                    tid = proc.tid + 1;
+                    return print(proc);
+                });
+                if (shown < PROCESS_PAGE) {
+                    tid = max(tid, liveTid);
+                }
+                continue;
+            }
+            auto pin = processes.pin();
+            for (; shown < PROCESS_PAGE && tid <= processes.size(); tid++) {
+                Process* live = findProcess(tid);
+                if (!live) {
+                    if (tid - 1 < processes.liveBegin()) {
+                        break; // Archived meanwhile
+                    }
+                    continue;
+                }
+                Process proc;
+                {
+                    lock_guard<mutex> lock(accountLock(live->aid));
+                    proc = *live;
+                }
+                if (!accountId || proc.aid == accountId ||
+                    (proc.type == TransactionType::Transfer && proc.toAid == accountId)) {
+                    print(proc);
+                }
+            }
+        }
+        return tid <= processes.size() ? tid : 0;
+    }
+
+    // Totals over all accounts, consistent as of one instant: every
+    // balance change happens under a stripe, so all stripes are held
+    BankSummary summarize() {
+        unique_lock<mutex> locks[LOCK_STRIPES];
+        for (int s = 0; s < LOCK_STRIPES; s++) {
+            locks[s] = unique_lock<mutex>(accountLocks[s].m);
+        }
+        return columns.summarize(accounts.size());
+    }
+
+    // Display the bank summary
+    void printSummary() {
+        auto start = chrono::steady_clock::now();
+        BankSummary sum = summarize();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << "\nBank Summary:" << endl;
+        cout << "Accounts: " << sum.accounts << " (" << sum.active << " active, "
+             << sum.accounts - sum.active << " inactive)" << endl;
+        cout << "Total Balance: $" << formatMoney(sum.total) << endl;
+        if (sum.active > 0) {
+            cout << "Lowest Balance: $" << formatMoney(sum.minBalance) << endl;
+            cout << "Highest Balance: $" << formatMoney(sum.maxBalance) << endl;
+        }
+        cout << "Band\t\t\tAccounts" << endl;
+        for (int k = 0; k < BALANCE_BANDS; k++) {
+            string band = k == 0 ? "Overdrawn"
+                        : k == 1 ? "0.00"
+                        : formatMoney(BALANCE_BAND_FLOOR[k]) +
+                              (k + 1 < BALANCE_BANDS ? " - " + formatMoney(BALANCE_BAND_FLOOR[k + 1] - 1) : " +");
+            cout << band << (band.size() < 8 ? "\t\t\t" : band.size() < 16 ? "\t\t" : "\t") << sum.bands[k] << endl;
+        }
+        cout << "Computed in " << fixed << setprecision(3) << ms << " ms" << endl;
+    }
+
+    // Accounts of a customer in creation order, with each balance read
+    // lock-free; total sums the active ones
+    struct CustomerAccount {
+        int id;
+        Money balance;
+        bool active;
+    };
+    vector<CustomerAccount> customerAccounts(const string& customerId, Money* total = nullptr) {
+        vector<CustomerAccount> list;
+        Money sum = 0;
+        for (int accountId : customers.accountsOf(customerId)) {
+            CustomerAccount acc{accountId, 0, false};
+            acc.active = readBalance(accountId, acc.balance);
+            if (acc.active) {
+                sum += acc.balance;
+            }
+            list.push_back(acc);
+        }
+        if (total) {
+            *total = sum;
+        }
+        return list;
+    }
+
+    // Display every account of a customer and their total balance
+    void printCustomer(const string& customerId) {
+        Money total;
+        vector<CustomerAccount> list = customerAccounts(customerId, &total);
+        if (list.empty()) {
+            cout << "Error: No accounts for customer " << customerId << "." << endl;
+            return;
+        }
+        cout << "\nAccounts of " << customerId << ":" << endl;
+        cout << "AID\tBalance\t\tStatus" << endl;
+        for (const CustomerAccount& acc : list) {
+            cout << acc.id << "\t" << formatMoney(acc.balance) << "\t\t" << (acc.active ? "Active" : "Closed") << endl;
+        }
+        cout << "Total Balance: $" << formatMoney(total) << endl;
+    }
+
+    // Display memory used by account and process storage
+    void printStorageUsage() {
+        int accountCount = accounts.size();
+        size_t accountBytes = accounts.bytesUsed() + columns.bytesUsed();
+        cout << "\nStorage Usage:" << endl;
+        cout << "Accounts: " << accountCount << " (" << accountBytes << " bytes";
+        if (accountCount > 0) {
+            cout << ", " << accountBytes / accountCount << " bytes per account";
+        }
+        cout << ")" << endl;
+        cout << "Customers: " << customers.size() << " (" << customers.bytesUsed() << " bytes)" << endl;
+        cout << "Processes: " << processes.size() - processes.liveBegin() << " in memory ("
+             << processes.bytesUsed() << " bytes)";
+        if (archive.isOpen()) {
+            cout << ", " << processes.liveBegin() << " archived (" << archive.bytesUsed() << " bytes)";
+        }
+        cout << endl;
+        cout << "Idempotency keys: " << recentKeys.repeatCount() << " retries answered ("
+             << recentKeys.bytesUsed() << " bytes)" << endl;
+    }
+};
+
+// TCP front end: one epoll thread speaking a line protocol, one request
+// per line and one reply line per request, in request order. Clients
+// may pipeline any number of requests:
+//   OPEN customer amount           -> OK account-ID | ERR message
+//   DEPOSIT account amount [key]   -> OK TID        | ERR TID message
+//   WITHDRAW account amount [key]  -> OK TID        | ERR TID message
+//   TRANSFER from to amount [key]  -> OK TID        | ERR TID message
+//   BALANCE account                -> OK amount     | ERR message
+// and, for a BankRouter running two-phase commit across nodes:
+//   PREPARE id DEBIT|CREDIT account amount -> OK | ERR message
+//   COMMIT id                              -> OK | ERR message
+//   ABORT id                               -> OK | ERR message
+// Amounts are in units, e.g. 12.50. Deposits, withdrawals and transfers
+// that arrive together, from all connections, run as one submitBatch on
+// the worker pool; balances are read lock-free. Replies go out once the
+// journal has the changes they report. A request that repeats the key
+// of one on the same account within DEDUPE_TTL_S gets that request's
+// reply and does not run again, so clients can retry safely.
+class BankServer {
+private:
+    struct Connection {
+        string in;  // Received bytes; requests before inPos are done
+        size_t inPos = 0;
+        string out; // Replies not yet sent
+        uint32_t events = 0;  // Current epoll interest
+        bool queued = false;  // In ready, with complete requests to serve
+        bool closing = false; // Peer is done sending; close once out is sent
+    };
+
+    BankSystem& bank;
+    int listenFd = -1;
+    int epollFd = -1;
+    unordered_map<int, Connection> conns;
+    vector<int> ready;       // Connections with requests to serve
+    vector<int> dirty;       // Connections with replies to send
+    vector<BatchItem> batch; // Requests of the current round
+    vector<int> batchFds;    // Connection of each batch item
+    bool needSync = false;   // A direct request changed journaled state
+
+    // PREPARE, COMMIT and ABORT of a transfer id; the holds live in the
+    // bank, so they are journaled and survive a restart
+    string serveTwoPhase(const string& command, istringstream& args) {
+        string id;
+        if (!(args >> id) || id.size() > HOLD_ID_MAX) {
+            return "ERR Bad request";
+        }
+        ProcessResult result;
+        if (command == "PREPARE") {
+            string side;
+            int accountId;
+            double amount;
+            if (!(args >> side >> accountId >> amount) || (side != "DEBIT" && side != "CREDIT")) {
+                return "ERR Bad request";
+            }
+            if (!fitsMoney(amount)) {
+                return "ERR Invalid amount";
+            }
+            result = bank.prepareHold(id, accountId, toMoney(amount), side == "DEBIT");
+        } else {
+            result = bank.resolveHold(id, command == "COMMIT");
+            if (result == ProcessResult::NotFound) {
+                return "ERR Unknown transfer";
+            }
+        }
+        needSync = true;
+        return result == ProcessResult::Completed ? "OK" : "ERR " + string(toString(result));
+    }
+
+    static int wakeFd; // eventfd the signal handler writes to
+
+    static void onSignal(int) {
+        uint64_t one = 1;
+        ssize_t written = write(wakeFd, &one, sizeof(one));
+        (void)written;
+    }
+
+    void watch(int fd, Connection& conn) {
+        uint32_t events = conn.out.empty() ? 0u : (uint32_t)EPOLLOUT;
+        if (!conn.closing && conn.out.size() < SERVER_MAX_OUT) {
+            events |= EPOLLIN; // Stop reading a client that doesn't read its replies
+        }
+        if (events != conn.events) {
+            epoll_event ev{};
+            ev.events = events;
+            ev.data.fd = fd;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev);
+            conn.events = events;
+        }
+    }
+
+    void closeConnection(int fd) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        conns.erase(fd);
+    }
+
+    void acceptConnections() {
+        while (true) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                return; // EAGAIN once the backlog is drained
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+                ::close(fd);
+                continue;
+            }
+            conns[fd].events = EPOLLIN;
+        }
+    }
+
+    // Read everything available; false if the connection was closed
+    bool receive(int fd, Connection& conn) {
+        char buf[1 << 16];
+        while (true) {
+            ssize_t got = recv(fd, buf, sizeof(buf), 0);
+            if (got > 0) {
+                conn.in.append(buf, (size_t)got);
+                continue;
+            }
+            if (got == 0) {
+                conn.closing = true;
+                dirty.push_back(fd); // Closed by send once the replies are out
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                closeConnection(fd);
+                return false;
+            }
+            break;
+        }
+        if (conn.in.find('\n', conn.inPos) == string::npos && conn.in.size() - conn.inPos > SERVER_MAX_LINE) {
+            reply(fd, conn, "ERR Request too long");
+            conn.in.clear();
+            conn.inPos = 0;
+            conn.closing = true;
+        }
+        if (!conn.queued) {
+            conn.queued = true;
+            ready.push_back(fd);
+        }
+        return true;
+    }
+
+    // Send what the socket takes; false if the connection was closed
+    bool send(int fd, Connection& conn) {
+        size_t sent = 0;
+        while (sent < conn.out.size()) {
+            ssize_t n = ::send(fd, conn.out.data() + sent, conn.out.size() - sent, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;
+                }
+                closeConnection(fd);
+                return false;
+            }
+            sent += (size_t)n;
+        }
+        conn.out.erase(0, sent);
+        if (conn.out.empty() && conn.closing && !conn.queued) {
+            closeConnection(fd);
+            return false;
+        }
+        watch(fd, conn);
+        return true;
+    }
+
+    void reply(int fd, Connection& conn, const string& line) {
+        if (conn.out.empty()) {
+            dirty.push_back(fd);
+        }
+        conn.out += line;
+        conn.out += '\n';
+    }
+
+    // Answer a request that doesn't go through the batch
+    void serveDirect(int fd, Connection& conn, const string& command, istringstream& args) {
+        if (command == "OPEN") {
+            string customerId;
+            double amount;
+            if (!(args >> customerId >> amount)) {
+                reply(fd, conn, "ERR Bad request");
+            } else if (!fitsMoney(amount)) {
+                reply(fd, conn, "ERR Invalid amount");
+            } else if (amount < 0) {
+                reply(fd, conn, "ERR Negative balance");
+            } else if (customerId.size() > CUSTOMER_ID_MAX) {
+                reply(fd, conn, "ERR Customer ID too long");
+            } else {
+                int accountId = bank.addAccount(customerId, toMoney(amount));
+                reply(fd, conn, accountId < 0 ? "ERR Account table full" : "OK " + to_string(accountId));
+                needSync = true;
+            }
+        } else if (command == "BALANCE") {
+            int accountId;
+            Money balance;
+            if (!(args >> accountId)) {
+                reply(fd, conn, "ERR Bad request");
+            } else if (!bank.readBalance(accountId, balance)) {
+                reply(fd, conn, "ERR Account not found");
+            } else {
+                reply(fd, conn, "OK " + formatMoney(balance));
+            }
+        } else if (command == "PREPARE" || command == "COMMIT" || command == "ABORT") {
+            reply(fd, conn, serveTwoPhase(command, args));
+        } else {
+            reply(fd, conn, "ERR Bad request");
+        }
+    }
+
+    // Take the connection's requests for this round, in order: direct
+    // requests until the first transaction, then transactions. A request
+    // that must run after the batch (a direct one, or a deposit or
+    // withdrawal after a transfer, which the batch would run first)
+    // waits for the next round.
+    void takeRequests(int fd, Connection& conn) {
+        bool batched = false;
+        bool transfers = false;
+        bool more = false;
+        size_t lineEnd;
+        while ((lineEnd = conn.in.find('\n', conn.inPos)) != string::npos) {
+            istringstream args(conn.in.substr(conn.inPos, lineEnd - conn.inPos));
+            string command;
+            args >> command;
+            BatchItem item{0, TransactionType::Deposit, 0, 0};
+            double amount = 0;
+            bool isTransaction = true;
+            if (command == "DEPOSIT" || command == "WITHDRAW") {
+                item.type = command == "DEPOSIT" ? TransactionType::Deposit : TransactionType::Withdraw;
+                isTransaction = (bool)(args >> item.accountId >> amount);
+            } else if (command == "TRANSFER") {
+                item.type = TransactionType::Transfer;
+                isTransaction = (bool)(args >> item.accountId >> item.toAccountId >> amount);
+            } else {
+                isTransaction = false;
+            }
+            bool badAmount = isTransaction && !fitsMoney(amount); // Refused like a direct request
+            isTransaction = isTransaction && !badAmount;
+            bool isTransfer = isTransaction && item.type == TransactionType::Transfer;
+            if ((batched && !isTransaction) || (transfers && !isTransfer)) {
+                more = true;
+                break;
+            }
+            conn.inPos = lineEnd + 1;
+            if (badAmount) {
+                reply(fd, conn, "ERR Invalid amount");
+                continue;
+            }
+            if (!isTransaction) {
+                serveDirect(fd, conn, command, args);
+                continue;
+            }
+            item.amount = toMoney(amount);
+            string key;
+            if (args >> key) {
+                item.key = idempotencyKey(item.accountId, key);
+            }
+            batch.push_back(item);
+            batchFds.push_back(fd);
+            batched = true;
+            transfers = transfers || isTransfer;
+        }
+        conn.in.erase(0, conn.inPos);
+        conn.inPos = 0;
+        conn.queued = more;
+        if (more) {
+            ready.push_back(fd);
+        }
+    }
+
+    // Serve requests in rounds until every connection is waiting for input
+    void serveRequests() {
+        while (!ready.empty()) {
+            vector<int> round;
+            round.swap(ready);
+            for (int fd : round) {
+                auto it = conns.find(fd);
+                if (it != conns.end()) {
+                    takeRequests(fd, it->second);
+                }
+            }
+            if (!batch.empty()) {
+                vector<BatchResult> results = bank.submitBatch(batch.data(), (int)batch.size());
+                for (size_t i = 0; i < results.size(); i++) {
+                    Connection& conn = conns[batchFds[i]];
+                    string tid = to_string(results[i].tid);
+                    if (results[i].result == ProcessResult::Completed) {
+                        reply(batchFds[i], conn, "OK " + tid);
+                    } else {
+                        reply(batchFds[i], conn, "ERR " + tid + " " + toString(results[i].result));
+                    }
+                }
+                batch.clear();
+                batchFds.clear();
+            }
+        }
+        if (needSync) {
+            bank.syncJournal(); // submitBatch syncs its own changes
+            needSync = false;
+        }
+    }
+
+public:
+    explicit BankServer(BankSystem& bank) : bank(bank) {}
+    BankServer(const BankServer&) = delete;
+    BankServer& operator=(const BankServer&) = delete;
+
+    ~BankServer() {
+        for (auto& entry : conns) {
+            ::close(entry.first);
+        }
+        for (int fd : {listenFd, epollFd, wakeFd}) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        wakeFd = -1;
+    }
+
+    // Listen on all interfaces; false with a message if that fails
+    bool listen(int port) {
+        listenFd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0); // Also takes IPv4
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (listenFd < 0 || epollFd < 0 || wakeFd < 0) {
+            cout << "Error: " << strerror(errno) << endl;
+            return false;
+        }
+        int on = 1;
+        int off = 0;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        setsockopt(listenFd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        sockaddr_in6 addr{};
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr = in6addr_any;
+        addr.sin6_port = htons((uint16_t)port);
+        if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(listenFd, SERVER_BACKLOG) != 0) {
+            cout << "Error: Cannot listen on port " << port << ": " << strerror(errno) << endl;
+            return false;
+        }
+        for (int fd : {listenFd, wakeFd}) {
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.fd = fd;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+        }
+        return true;
+    }
+
+    // Serve until SIGINT or SIGTERM
+    void run() {
+        signal(SIGINT, onSignal);
+        signal(SIGTERM, onSignal);
+        epoll_event events[SERVER_MAX_EVENTS];
+        bool stopping = false;
+        while (!stopping) {
+            int n = epoll_wait(epollFd, events, SERVER_MAX_EVENTS, -1);
+            if (n < 0 && errno != EINTR) {
+                cout << "Error: " << strerror(errno) << endl;
+                break;
+            }
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (fd == listenFd) {
+                    acceptConnections();
+                    continue;
+                }
+                if (fd == wakeFd) {
+                    stopping = true;
+                    continue;
+                }
+                auto it = conns.find(fd);
+                if (it == conns.end()) {
+                    continue;
+                }
+                if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !receive(fd, it->second)) {
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT) {
+                    dirty.push_back(fd);
+                }
+            }
+            serveRequests();
+            vector<int> sending;
+            sending.swap(dirty);
+            for (int fd : sending) {
+                auto it = conns.find(fd);
+                if (it != conns.end()) {
+                    send(fd, it->second);
+                }
+            }
+        }
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+    }
 };
 
-// Banking system
-class BankSystem {
+int BankServer::wakeFd = -1;
+
+// Thin client for a BankServer: the basic menu, with every operation sent
+// as one request line
+class BankClient {
 private:
-    Account accounts[MAX_ACCOUNTS];
-    Process processes[MAX_PROCESSES];
-    int accountCount = 0;
-    int processCount = 0;
-    int nextAccountId = 1;
-    int nextTransactionId = 1;
-    mutex bankMutex; // Mutex for bank-level synchronization
+    int fd = -1;
+    string in; // Received bytes after the last reply line
 
 public:
-    // Create an account
-    int createAccount(const string& customerId, double initialBalance) {
-        lock_guard<mutex> lock(bankMutex); // Synchronize account creation
-        if (accountCount >= MAX_ACCOUNTS) {
-            cout << "Error: Maximum account limit reached." << endl;
-            return -1;
+    BankClient() = default;
+    BankClient(const BankClient&) = delete;
+    BankClient& operator=(const BankClient&) = delete;
+
+    ~BankClient() {
+        if (fd >= 0) {
+            ::close(fd);
         }
-        if (initialBalance < 0) {
-            cout << "Error: Initial balance cannot be negative." << endl;
-            return -1;
+    }
+
+    // Connect to host:port; false with a message if that fails
+    bool connect(const string& host, const string& port) {
+        addrinfo hints{};
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* found = nullptr;
+        int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &found);
+        if (err != 0) {
+            cout << "Error: " << gai_strerror(err) << endl;
+            return false;
         }
-        int accountId = nextAccountId++;
-        accounts[accountCount].id = accountId;
-        accounts[accountCount].customerId = customerId;
-        accounts[accountCount].balance = initialBalance;
-        accounts[accountCount].active = true;
-        accountCount++;
-        cout << "Account created successfully! Account ID: " << accountId << endl;
-        return accountId;
+        for (addrinfo* ai = found; ai && fd < 0; ai = ai->ai_next) {
+            fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+            if (fd >= 0 && ::connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(found);
+        if (fd < 0) {
+            cout << "Error: Cannot connect to " << host << ":" << port << endl;
+        }
+        return fd >= 0;
     }
 
-    // Create a transaction process
-    int createProcess(int accountId, const string& type, double amount) {
-        lock_guard<mutex> lock(bankMutex); // Synchronize process creation
-        if (processCount >= MAX_PROCESSES) {
-            cout << "Error: Maximum process limit reached." << endl;
-            return -1;
+    // Send request lines, each ending in a newline; false if the server went away
+    bool send(const string& lines) {
+        for (size_t sent = 0; sent < lines.size();) {
+            ssize_t n = ::send(fd, lines.data() + sent, lines.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return false;
+            }
+            sent += (size_t)n;
         }
-        int tid = nextTransactionId++;
-        processes[processCount].tid = tid;
-        processes[processCount].aid = accountId;
-        processes[processCount].type = type;
-        processes[processCount].amount = amount;
-        processes[processCount].status = "Pending";
-        processCount++;
-        cout << "Process created successfully! Transaction ID: " << tid << endl;
-        return tid;
+        return true;
     }
 
-    // Execute a transaction process
-    void executeProcess(int tid) {
-        thread([this, tid]() {
-            lock_guard<mutex> lock(bankMutex); // Synchronize process execution
-            for (int i = 0; i < processCount; i++) {
-                if (processes[i].tid == tid) {
-                    Process& proc = processes[i];
-                    Account* acc = findAccount(proc.aid);
-                    if (!acc) {
-                        cout << "Error: Account not found for transaction " << tid << endl;
-                        proc.status = "Failed";
-                        return;
-                    }
+    // Send one request and wait for its reply; empty if the server went away
+    string request(const string& line) {
+        return send(line + "\n") ? readReply() : "";
+    }
 
-                    // Synchronize account operations
-                    lock_guard<mutex> accLock(acc->accMutex);
-                    if (proc.type == "Deposit") {
-                        if (proc.amount <= 0) {
-                            cout << "Error: Invalid deposit amount." << endl;
-                            proc.status = "Failed";
-                            return;
-                        }
-                        acc->balance += proc.amount;
-                        proc.status = "Completed";
-                        cout << "Transaction " << tid << ": Deposit successful! New balance: " << acc->balance << endl;
-                    } else if (proc.type == "Withdraw") {
-                        if (proc.amount <= 0 || acc->balance < proc.amount) {
-                            cout << "Error: Insufficient funds or invalid withdrawal amount." << endl;
-                            proc.status = "Failed";
-                            return;
-                        }
-                        acc->balance -= proc.amount;
-                        proc.status = "Completed";
-                        cout << "Transaction " << tid << ": Withdrawal successful! New balance: " << acc->balance << endl;
-                    } else {
-                        cout << "Error: Unknown transaction type." << endl;
-                        proc.status = "Failed";
-                    }
-                    return;
+    // Wait for the next reply line; empty if the server went away
+    string readReply() {
+        size_t lineEnd;
+        while ((lineEnd = in.find('\n')) == string::npos) {
+            char buf[4096];
+            ssize_t got = recv(fd, buf, sizeof(buf), 0);
+            if (got <= 0) {
+                return "";
+            }
+            in.append(buf, (size_t)got);
+        }
+        string reply = in.substr(0, lineEnd);
+        in.erase(0, lineEnd + 1);
+        return reply;
+    }
+};
+
+// Print a server reply: the OK value through format, or the error
+void printReply(const string& reply, const string& format) {
+    if (reply.empty()) {
+        cout << "Error: Connection to the server lost." << endl;
+    } else if (reply.compare(0, 3, "OK ") == 0) {
+        cout << format << reply.substr(3) << endl;
+    } else {
+        cout << "Error: " << (reply.compare(0, 4, "ERR ") == 0 ? reply.substr(4) : reply) << endl;
+    }
+}
+
+// Menu for a remote banking system
+void clientMenu(BankClient& client) {
+    while (true) {
+        cout << "\n------ Banking System (remote) ------" << endl;
+        cout << "1. Create Account" << endl;
+        cout << "2. Deposit" << endl;
+        cout << "3. Withdraw" << endl;
+        cout << "4. Check Balance" << endl;
+        cout << "5. Transfer" << endl;
+        cout << "6. Exit" << endl;
+        cout << "Enter your choice: ";
+        int choice;
+        if (!(cin >> choice)) {
+            return;
+        }
+
+        int accountId;
+        double amount;
+        switch (choice) {
+        case 1: {
+            string customerId;
+            cout << "Enter customer ID: ";
+            cin >> customerId;
+            cout << "Enter initial balance: ";
+            cin >> amount;
+            printReply(client.request("OPEN " + customerId + " " + formatMoney(toMoney(amount))),
+                       "Account created successfully! Account ID: ");
+            break;
+        }
+        case 2:
+        case 3:
+            cout << "Enter account ID: ";
+            cin >> accountId;
+            cout << (choice == 2 ? "Enter amount to deposit: " : "Enter amount to withdraw: ");
+            cin >> amount;
+            printReply(client.request(string(choice == 2 ? "DEPOSIT " : "WITHDRAW ") + to_string(accountId) + " " +
+                                      formatMoney(toMoney(amount))),
+                       "Completed, Transaction ID: ");
+            break;
+        case 4:
+            cout << "Enter account ID: ";
+            cin >> accountId;
+            printReply(client.request("BALANCE " + to_string(accountId)),
+                       "Balance for Account ID " + to_string(accountId) + ": ");
+            break;
+        case 5: {
+            int toAccountId;
+            cout << "Enter source account ID: ";
+            cin >> accountId;
+            cout << "Enter destination account ID: ";
+            cin >> toAccountId;
+            cout << "Enter amount to transfer: ";
+            cin >> amount;
+            printReply(client.request("TRANSFER " + to_string(accountId) + " " + to_string(toAccountId) + " " +
+                                      formatMoney(toMoney(amount))),
+                       "Completed, Transaction ID: ");
+            break;
+        }
+        case 6:
+            return;
+        default:
+            cout << "Invalid choice. Please try again." << endl;
+        }
+    }
+}
+
+// Traffic and latency of one shard as seen by the router
+struct alignas(64) ShardStats {
+    atomic<uint64_t> requests{0};
+    atomic<uint64_t> failed{0};    // ERR replies and lost connections
+    atomic<uint64_t> latencyNs{0}; // Summed time from send to reply
+};
+
+// Front end for several BankServer nodes. Account IDs are partitioned
+// across the N shards: global ID g lives on shard (g - 1) % N as local
+// ID (g - 1) / N + 1, so the router needs no directory. A customer's
+// accounts all open on the shard its ID hashes to. The router speaks
+// the same protocol as a node and forwards each request to the shard
+// that owns its account, keeping pipelined requests in flight.
+// Transfers between shards run as a two-phase commit: PREPARE DEBIT on
+// the source, PREPARE CREDIT on the destination, then COMMIT both, or
+// ABORT whatever was prepared. A COMMIT without a reply is sent again
+// on a new connection; if it still gets none the client is told the
+// transfer is in doubt, with its ID, and the holds stay on the nodes
+// for a later COMMIT. A router that dies between the phases leaves the
+// debit held on its node.
+// Each client gets a thread with its own connection to every shard.
+class BankRouter {
+private:
+    vector<string> shardAddresses;
+    unique_ptr<ShardStats[]> stats;
+    int listenFd = -1;
+    atomic<bool> stopping{false};
+    atomic<uint64_t> nextTransfer{1};
+    mutex clientsMutex;
+    vector<int> clientFds;
+    unordered_map<uint64_t, thread> clientThreads; // By client number
+    vector<uint64_t> finishedClients; // Threads about to return, joined by run
+    uint64_t nextClient = 0;
+    chrono::steady_clock::time_point started = chrono::steady_clock::now();
+
+    static BankRouter* active; // The router the signal handler stops
+
+    static void onSignal(int) {
+        active->stopping.store(true);
+        shutdown(active->listenFd, SHUT_RDWR); // Fails accept, async-signal-safe
+    }
+
+    int shardCount() const { return (int)shardAddresses.size(); }
+    int shardOf(int globalId) const { return (globalId - 1) % shardCount(); }
+    int localId(int globalId) const { return (globalId - 1) / shardCount() + 1; }
+    int globalId(int shard, int local) const { return (local - 1) * shardCount() + shard + 1; }
+
+    // A forwarded request waiting for its reply
+    struct InFlight {
+        int shard;
+        bool open; // The reply carries a local account ID to map back
+        chrono::steady_clock::time_point sent;
+    };
+
+    void count(int shard, const string& reply, chrono::steady_clock::time_point sent) {
+        ShardStats& s = stats[shard];
+        s.requests.fetch_add(1, memory_order_relaxed);
+        s.latencyNs.fetch_add((uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+            chrono::steady_clock::now() - sent).count(), memory_order_relaxed);
+        if (reply.compare(0, 2, "OK") != 0) {
+            s.failed.fetch_add(1, memory_order_relaxed);
+        }
+    }
+
+    // One round trip to a shard, counted
+    string ask(vector<unique_ptr<BankClient>>& shards, int shard, const string& line) {
+        auto sent = chrono::steady_clock::now();
+        string reply = shards[shard]->request(line);
+        count(shard, reply, sent);
+        return reply;
+    }
+
+    // Send COMMIT id to a shard until it answers, reconnecting when the
+    // connection is gone. "Unknown transfer" on a retry means an earlier
+    // try went through and only its reply was lost. False if the shard
+    // never answered or the commit failed.
+    bool commit(vector<unique_ptr<BankClient>>& shards, int shard, const string& id) {
+        for (int attempt = 0; attempt < COMMIT_ATTEMPTS; attempt++) {
+            if (attempt > 0) {
+                this_thread::sleep_for(chrono::milliseconds(COMMIT_RETRY_MS));
+                const string& address = shardAddresses[shard];
+                size_t colon = address.rfind(':');
+                unique_ptr<BankClient> fresh(new BankClient());
+                if (!fresh->connect(address.substr(0, colon), address.substr(colon + 1))) {
+                    continue;
                 }
+                shards[shard] = move(fresh);
             }
-            cout << "Error: Transaction ID not found." << endl;
-        }).join(); // Ensure thread completes execution
+            string reply = ask(shards, shard, "COMMIT " + id);
+            if (!reply.empty()) {
+                return reply == "OK" || (attempt > 0 && reply == "ERR Unknown transfer");
+            }
+        }
+        return false;
     }
 
-    // Find an account by ID
-    Account* findAccount(int accountId) {
-        for (int i = 0; i < accountCount; i++) {
-            if (accounts[i].active && accounts[i].id == accountId) {
-                return &accounts[i];
+    // Two-phase commit of a transfer between two shards
+    string transfer(vector<unique_ptr<BankClient>>& shards, int from, int to, const string& amount) {
+        int fromShard = shardOf(from);
+        int toShard = shardOf(to);
+        string id = "r" + to_string(getpid()) + "-" + to_string(nextTransfer.fetch_add(1));
+        string debit = ask(shards, fromShard, "PREPARE " + id + " DEBIT " + to_string(localId(from)) + " " + amount);
+        if (debit != "OK") {
+            return debit.empty() ? "ERR Shard unavailable" : debit;
+        }
+        string credit = ask(shards, toShard, "PREPARE " + id + " CREDIT " + to_string(localId(to)) + " " + amount);
+        if (credit != "OK") {
+            ask(shards, fromShard, "ABORT " + id);
+            ask(shards, toShard, "ABORT " + id); // In case only its reply was lost
+            return credit.empty() ? "ERR Shard unavailable" : credit;
+        }
+        bool committed = commit(shards, fromShard, id);
+        committed = commit(shards, toShard, id) && committed;
+        return committed ? "OK " + id : "ERR In doubt " + id;
+    }
+
+    // Collect the replies of everything in flight, in request order
+    void drain(vector<unique_ptr<BankClient>>& shards, deque<InFlight>& inFlight, string& out) {
+        for (const InFlight& req : inFlight) {
+            string reply = shards[req.shard]->readReply();
+            count(req.shard, reply, req.sent);
+            if (reply.empty()) {
+                reply = "ERR Shard unavailable";
+            } else if (req.open && reply.compare(0, 3, "OK ") == 0) {
+                reply = "OK " + to_string(globalId(req.shard, stoi(reply.substr(3))));
             }
+            out += reply + "\n";
         }
-        return nullptr;
+        inFlight.clear();
     }
 
-    // Check account balance
-    double checkBalance(int accountId) {
-        Account* acc = findAccount(accountId);
-        if (!acc) {
-            cout << "Error: Invalid account ID." << endl;
-            return -1;
+    // Rewrite a request for its shard; false if it has to be handled here
+    bool route(const string& line, int& shard, string& forward, bool& open) {
+        istringstream args(line);
+        string command;
+        args >> command;
+        open = command == "OPEN";
+        if (open) {
+            string customerId;
+            if (!(args >> customerId)) {
+                return false;
+            }
+            shard = (int)(hash<string>()(customerId) % (size_t)shardCount());
+            forward = line;
+            return true;
+        }
+        int accountId;
+        if (!(args >> accountId) || accountId < 1) {
+            return false;
+        }
+        shard = shardOf(accountId);
+        string rest;
+        getline(args, rest);
+        if (command == "TRANSFER") {
+            istringstream more(rest);
+            int toAccountId;
+            string amount;
+            if (!(more >> toAccountId >> amount) || toAccountId < 1 || shardOf(toAccountId) != shard) {
+                return false;
+            }
+            getline(more, rest); // An idempotency key, if any
+            forward = command + " " + to_string(localId(accountId)) + " " + to_string(localId(toAccountId)) + " " +
+                      amount + rest;
+            return true;
         }
-        lock_guard<mutex> lock(acc->accMutex); // Synchronize balance check
-        return acc->balance;
+        if (command != "DEPOSIT" && command != "WITHDRAW" && command != "BALANCE") {
+            return false;
+        }
+        forward = command + " " + to_string(localId(accountId)) + rest;
+        return true;
     }
 
-    // Display all processes
-    void printProcesses() {
-        lock_guard<mutex> lock(bankMutex);
-        cout << "\nProcess Table:" << endl;
-        cout << "TID\tAID\tType\t\tAmount\tStatus" << endl;
-        for (int i = 0; i < processCount; i++) {
-            cout << processes[i].tid << "\t" << processes[i].aid << "\t"
-                 << processes[i].type << "\t\t" << processes[i].amount << "\t"
-                 << processes[i].status << endl;
+    // A request the router answers itself
+    string serveHere(vector<unique_ptr<BankClient>>& shards, const string& line) {
+        istringstream args(line);
+        string command;
+        int from;
+        int to;
+        string amount;
+        args >> command;
+        if (command == "TRANSFER" && (args >> from >> to >> amount) && from >= 1 && to >= 1) {
+            return transfer(shards, from, to, amount);
+        }
+        if (command == "STATS") {
+            return "OK " + statsLine();
+        }
+        return "ERR Bad request";
+    }
+
+    void serveClient(int fd, uint64_t client) {
+        vector<unique_ptr<BankClient>> shards;
+        bool connected = true;
+        for (const string& address : shardAddresses) {
+            size_t colon = address.rfind(':');
+            shards.emplace_back(new BankClient());
+            connected = connected && shards.back()->connect(address.substr(0, colon), address.substr(colon + 1));
+        }
+        string in;
+        char buf[1 << 16];
+        ssize_t got;
+        while (connected && (got = recv(fd, buf, sizeof(buf), 0)) > 0) {
+            in.append(buf, (size_t)got);
+            string out;
+            deque<InFlight> inFlight;
+            size_t pos = 0;
+            size_t lineEnd;
+            while ((lineEnd = in.find('\n', pos)) != string::npos) {
+                string line = in.substr(pos, lineEnd - pos);
+                pos = lineEnd + 1;
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                int shard;
+                string forward;
+                bool open;
+                if (route(line, shard, forward, open)) {
+                    if (!shards[shard]->send(forward + "\n")) {
+                        connected = false;
+                        break;
+                    }
+                    inFlight.push_back({shard, open, chrono::steady_clock::now()});
+                } else {
+                    drain(shards, inFlight, out); // Replies stay in request order
+                    out += serveHere(shards, line) + "\n";
+                }
+            }
+            in.erase(0, pos);
+            drain(shards, inFlight, out);
+            if (::send(fd, out.data(), out.size(), MSG_NOSIGNAL) < (ssize_t)out.size()) {
+                break;
+            }
+        }
+        lock_guard<mutex> lock(clientsMutex);
+        clientFds.erase(find(clientFds.begin(), clientFds.end(), fd));
+        ::close(fd);
+        finishedClients.push_back(client);
+    }
+
+public:
+    explicit BankRouter(const vector<string>& shardAddresses)
+        : shardAddresses(shardAddresses), stats(new ShardStats[shardAddresses.size()]) {}
+    BankRouter(const BankRouter&) = delete;
+    BankRouter& operator=(const BankRouter&) = delete;
+
+    ~BankRouter() {
+        if (listenFd >= 0) {
+            ::close(listenFd);
+        }
+    }
+
+    // One line of per-shard throughput and latency
+    string statsLine() const {
+        double seconds = max(1e-9, chrono::duration<double>(chrono::steady_clock::now() - started).count());
+        ostringstream line;
+        line << fixed << setprecision(1);
+        for (int s = 0; s < shardCount(); s++) {
+            uint64_t requests = stats[s].requests.load(memory_order_relaxed);
+            line << (s ? "; " : "") << "shard " << s << " " << requests << " requests " << requests / seconds
+                 << "/sec " << (requests ? stats[s].latencyNs.load(memory_order_relaxed) / 1000.0 / requests : 0)
+                 << " us mean " << stats[s].failed.load(memory_order_relaxed) << " failed";
+        }
+        return line.str();
+    }
+
+    // Per-shard table for the console
+    void printStats(ostream& out) const {
+        double seconds = max(1e-9, chrono::duration<double>(chrono::steady_clock::now() - started).count());
+        out << "\nShard\tAddress\t\t\tRequests\tPer sec\tMean us\tFailed" << endl;
+        out << fixed << setprecision(1);
+        for (int s = 0; s < shardCount(); s++) {
+            uint64_t requests = stats[s].requests.load(memory_order_relaxed);
+            const string& address = shardAddresses[s];
+            out << s << "\t" << address << (address.size() < 8 ? "\t\t\t" : address.size() < 16 ? "\t\t" : "\t")
+                << requests << "\t\t" << requests / seconds << "\t"
+                << (requests ? stats[s].latencyNs.load(memory_order_relaxed) / 1000.0 / requests : 0) << "\t"
+                << stats[s].failed.load(memory_order_relaxed) << endl;
         }
     }
+
+    bool listen(int port) {
+        listenFd = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int on = 1;
+        int off = 0;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        setsockopt(listenFd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        sockaddr_in6 addr{};
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr = in6addr_any;
+        addr.sin6_port = htons((uint16_t)port);
+        if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(listenFd, SERVER_BACKLOG) != 0) {
+            cout << "Error: Cannot listen on port " << port << ": " << strerror(errno) << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Accept clients until SIGINT or SIGTERM
+    void run() {
+        active = this;
+        signal(SIGINT, onSignal);
+        signal(SIGTERM, onSignal);
+        while (!stopping.load()) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                break;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            vector<thread> finished;
+            {
+                lock_guard<mutex> lock(clientsMutex);
+                for (uint64_t client : finishedClients) {
+                    finished.push_back(move(clientThreads[client]));
+                    clientThreads.erase(client);
+                }
+                finishedClients.clear();
+                clientFds.push_back(fd);
+                clientThreads.emplace(nextClient, thread(&BankRouter::serveClient, this, fd, nextClient));
+                nextClient++;
+            }
+            for (thread& t : finished) {
+                t.join(); // Only its return is left
+            }
+        }
+        {
+            lock_guard<mutex> lock(clientsMutex);
+            for (int fd : clientFds) {
+                shutdown(fd, SHUT_RDWR); // Wake client threads blocked in recv
+            }
+        }
+        for (auto& entry : clientThreads) {
+            entry.second.join();
+        }
+        clientThreads.clear();
+        finishedClients.clear();
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        active = nullptr;
+    }
 };
 
+BankRouter* BankRouter::active = nullptr;
+
+// Read a batch of transactions from the console
+vector<BatchItem> readBatch() {
+    int count;
+    cout << "Enter number of transactions: ";
+    cin >> count;
+    vector<BatchItem> items;
+    cout << "Enter each as: account-ID D|W amount, or account-ID T amount to-account-ID" << endl;
+    for (int i = 0; i < count; i++) {
+        int accountId;
+        int toAccountId = 0;
+        char kind;
+        double amount;
+        cin >> accountId >> kind >> amount;
+        TransactionType type = (kind == 'W' || kind == 'w') ? TransactionType::Withdraw : TransactionType::Deposit;
+        if (kind == 'T' || kind == 't') {
+            type = TransactionType::Transfer;
+            cin >> toAccountId;
+        }
+        items.push_back({accountId, type, toMoney(amount), toAccountId});
+    }
+    return items;
+}
+
+// Report the failed items of a batch and the completed count
+void printBatchResults(const vector<BatchResult>& results) {
+    int completed = 0;
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results[i].result == ProcessResult::Completed) {
+            completed++;
+        } else {
+            cout << "Item " << i + 1 << " (TID " << results[i].tid << "): " << toString(results[i].result) << endl;
+        }
+    }
+    cout << "Batch done: " << completed << " of " << results.size() << " completed." << endl;
+}
+
+// Page through processes from fromTid on, optionally of one account
+void pageProcesses(BankSystem& bank, int fromTid, int accountId) {
+    int tid = fromTid;
+    while ((tid = bank.printProcesses(tid, accountId)) != 0) {
+        char more;
+        cout << "Show more? (y/n): ";
+        if (!(cin >> more) || (more != 'y' && more != 'Y')) {
+            break;
+        }
+    }
+}
+
 // Menu for the banking system
 void menu(BankSystem& bank) {
     while (true) {
+        bank.events().flush(); // Let pending messages print before the menu
         cout << "\n------ Banking System ------" << endl;
         cout << "1. Create Account" << endl;
         cout << "2. Deposit" << endl;
         cout << "3. Withdraw" << endl;
         cout << "4. Check Balance" << endl;
-        cout << "5. Display All Processes" << endl;
-        cout << "6. Exit" << endl;
+        cout << "5. Display Processes" << endl;
+        cout << "6. Storage Usage" << endl;
+        cout << "7. Submit Batch" << endl;
+        cout << "8. Write Snapshot" << endl;
+        cout << "9. Transfer" << endl;
+        cout << "10. Latency Metrics" << endl;
+        cout << "11. Bank Summary" << endl;
+        cout << "12. Customer Accounts" << endl;
+        cout << "13. Submit Batch to Worker Processes" << endl;
+        cout << "14. Account History" << endl;
+        cout << "15. Exit" << endl;
         cout << "Enter your choice: ";
         int choice;
         cin >> choice;
@@ -179,7 +4190,7 @@ void menu(BankSystem& bank) {
             cin >> customerId;
             cout << "Enter initial balance: ";
             cin >> initialBalance;
-            bank.createAccount(customerId, initialBalance);
+            bank.createAccount(customerId, toMoney(initialBalance));
             break;
         }
         case 2: {
@@ -189,8 +4200,8 @@ void menu(BankSystem& bank) {
             cin >> accountId;
             cout << "Enter amount to deposit: ";
             cin >> amount;
-            int tid = bank.createProcess(accountId, "Deposit", amount);
-            bank.executeProcess(tid);
+            int tid = bank.createProcess(accountId, TransactionType::Deposit, toMoney(amount));
+            bank.executeProcess(tid).wait();
             break;
         }
         case 3: {
@@ -200,24 +4211,95 @@ void menu(BankSystem& bank) {
             cin >> accountId;
             cout << "Enter amount to withdraw: ";
             cin >> amount;
-            int tid = bank.createProcess(accountId, "Withdraw", amount);
-            bank.executeProcess(tid);
+            int tid = bank.createProcess(accountId, TransactionType::Withdraw, toMoney(amount));
+            bank.executeProcess(tid).wait();
             break;
         }
         case 4: {
             int accountId;
             cout << "Enter account ID: ";
             cin >> accountId;
-            double balance = bank.checkBalance(accountId);
+            Money balance = bank.checkBalance(accountId);
             if (balance != -1) {
-                cout << "Balance for Account ID " << accountId << ": " << balance << endl;
+                cout << "Balance for Account ID " << accountId << ": " << formatMoney(balance) << endl;
             }
             break;
         }
-        case 5:
-            bank.printProcesses();
+        case 5: {
+            int tid;
+            cout << "Enter first TID to show (1 for the oldest): ";
+            cin >> tid;
+            pageProcesses(bank, tid, 0);
             break;
+        }
         case 6:
+            bank.printStorageUsage();
+            break;
+        case 7: {
+            vector<BatchItem> items = readBatch();
+            printBatchResults(bank.submitBatch(items.data(), (int)items.size()));
+            break;
+        }
+        case 8:
+            if (bank.snapshotFile().empty()) {
+                cout << "Error: Start with --snapshot FILE to enable snapshots." << endl;
+            } else if (bank.writeSnapshot(bank.snapshotFile())) {
+                cout << "Snapshot written to " << bank.snapshotFile() << endl;
+            } else {
+                cout << "Error: Cannot write snapshot " << bank.snapshotFile() << endl;
+            }
+            break;
+        case 9: {
+            int accountId, toAccountId;
+            double amount;
+            cout << "Enter source account ID: ";
+            cin >> accountId;
+            cout << "Enter destination account ID: ";
+            cin >> toAccountId;
+            cout << "Enter amount to transfer: ";
+            cin >> amount;
+            int tid = bank.createProcess(accountId, TransactionType::Transfer, toMoney(amount), toAccountId);
+            bank.executeProcess(tid).wait();
+            break;
+        }
+        case 10:
+            bank.stats().print(cout);
+            break;
+        case 11:
+            bank.printSummary();
+            break;
+        case 12: {
+            string customerId;
+            cout << "Enter customer ID: ";
+            cin >> customerId;
+            bank.printCustomer(customerId);
+            break;
+        }
+        case 13: {
+            int workers;
+            cout << "Enter number of worker processes: ";
+            cin >> workers;
+            vector<BatchItem> items = readBatch();
+            int crashed = 0;
+            vector<BatchResult> results = bank.submitBatchProcesses(items.data(), (int)items.size(), max(workers, 1), &crashed);
+            if (results.empty() && !items.empty()) {
+                cout << "Error: Cannot create the shared memory segment." << endl;
+                break;
+            }
+            if (crashed > 0) {
+                cout << crashed << " worker processes died; their unfinished transactions were rolled back and rerun." << endl;
+            }
+            printBatchResults(results);
+            break;
+        }
+        case 14: {
+            int accountId;
+            cout << "Enter account ID: ";
+            cin >> accountId;
+            pageProcesses(bank, 1, accountId);
+            break;
+        }
+        case 15:
             return;
         default:
             cout << "Invalid choice. Please try again." << endl;
@@ -225,9 +4307,207 @@ void menu(BankSystem& bank) {
     }
 }
 
-int main() {
+// Benchmark workload, the same in code1, code2 and Module 1-4 so their
+// CSV rows can be compared: BENCH_ACCOUNTS accounts, then every thread
+// creates and executes BENCH_OPS transactions of BENCH_AMOUNT. Accounts
+// are picked uniformly, or for the hot workload BENCH_HOT_PERCENT of
+// operations go to the first BENCH_HOT accounts.
+const int BENCH_ACCOUNTS = 1024;
+const int BENCH_HOT = 4;
+const int BENCH_HOT_PERCENT = 80;
+const int BENCH_OPS = 100000;      // Per thread
+const int BENCH_SAMPLE = 16;       // Time one in this many operations
+const Money BENCH_AMOUNT = 100;
+const Money BENCH_BALANCE = 1000000000000LL; // Withdrawals never run out
+
+// Deterministic per-thread operation stream (xorshift32)
+struct BenchStream {
+    uint32_t state;
+    bool hot;
+    int withdrawPercent;
+
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    int account() {
+        bool toHot = hot && next() % 100 < (uint32_t)BENCH_HOT_PERCENT;
+        return 1 + (int)(next() % (toHot ? BENCH_HOT : BENCH_ACCOUNTS));
+    }
+    bool withdraw() { return next() % 100 < (uint32_t)withdrawPercent; }
+};
+
+// q-th percentile of samples, which get reordered
+uint32_t benchPercentile(vector<uint32_t>& samples, double q) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t k = min(samples.size() - 1, (size_t)(q * samples.size()));
+    nth_element(samples.begin(), samples.begin() + k, samples.end());
+    return samples[k];
+}
+
+// Run the uniform and hot workloads with 1, 2, 4 ... maxThreads threads
+// and print one CSV row per run
+void runBenchmark(unsigned maxThreads, int withdrawPercent) {
+    vector<unsigned> threadCounts;
+    for (unsigned n = 1; n < maxThreads; n *= 2) {
+        threadCounts.push_back(n);
+    }
+    threadCounts.push_back(maxThreads);
+
+    cout << "variant,workload,threads,ops,ops_per_sec,speedup,p50_ns,p99_ns" << endl;
+    for (int hot = 0; hot < 2; hot++) {
+        double baseRate = 0;
+        for (unsigned threadCount : threadCounts) {
+            unique_ptr<BankSystem> bank(new BankSystem(false));
+            for (int a = 0; a < BENCH_ACCOUNTS; a++) {
+                bank->addAccount("bench", BENCH_BALANCE);
+            }
+            vector<vector<uint32_t>> samples(threadCount);
+            vector<thread> threads;
+            auto start = chrono::steady_clock::now();
+            for (unsigned t = 0; t < threadCount; t++) {
+                threads.emplace_back([&, t]() {
+                    BenchStream ops{2654435761u * (t + 1), hot == 1, withdrawPercent};
+                    vector<uint32_t>& mine = samples[t];
+                    mine.reserve(BENCH_OPS / BENCH_SAMPLE + 1);
+                    for (int op = 0; op < BENCH_OPS; op++) {
+                        bool timed = op % BENCH_SAMPLE == 0;
+                        auto opStart = timed ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+                        int accountId = ops.account();
+                        TransactionType type = ops.withdraw() ? TransactionType::Withdraw : TransactionType::Deposit;
+                        bank->runProcess(bank->addProcess(accountId, type, BENCH_AMOUNT));
+                        if (timed) {
+                            mine.push_back((uint32_t)chrono::duration_cast<chrono::nanoseconds>(
+                                chrono::steady_clock::now() - opStart).count());
+                        }
+                    }
+                });
+            }
+            for (thread& t : threads) {
+                t.join();
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            long ops = (long)threadCount * BENCH_OPS;
+            double rate = ops / seconds;
+            if (baseRate == 0) {
+                baseRate = rate;
+            }
+            vector<uint32_t> all;
+            for (vector<uint32_t>& mine : samples) {
+                all.insert(all.end(), mine.begin(), mine.end());
+            }
+            uint32_t p50 = benchPercentile(all, 0.50);
+            uint32_t p99 = benchPercentile(all, 0.99);
+            cout << "code2," << (hot ? "hot" : "uniform") << "/w" << withdrawPercent << "," << threadCount << ","
+                 << ops << "," << fixed << setprecision(0) << rate << "," << setprecision(2) << rate / baseRate
+                 << "," << p50 << "," << p99 << endl;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        unsigned maxThreads = argc > 2 ? (unsigned)stoul(argv[2]) : thread::hardware_concurrency();
+        int withdrawPercent = argc > 3 ? stoi(argv[3]) : 50;
+        runBenchmark(max(1u, maxThreads), min(max(withdrawPercent, 0), 100));
+        return 0;
+    }
+    if (argc > 2 && string(argv[1]) == "--connect") {
+        string address = argv[2];
+        size_t colon = address.rfind(':');
+        BankClient client;
+        if (colon == string::npos || !client.connect(address.substr(0, colon), address.substr(colon + 1))) {
+            cout << "Usage: --connect HOST:PORT" << endl;
+            return 1;
+        }
+        clientMenu(client);
+        return 0;
+    }
+    if (argc > 3 && string(argv[1]) == "--route") {
+        vector<string> shards;
+        istringstream list(argv[3]);
+        string address;
+        while (getline(list, address, ',')) {
+            if (address.rfind(':') == string::npos) {
+                cout << "Usage: --route PORT HOST:PORT,HOST:PORT,..." << endl;
+                return 1;
+            }
+            shards.push_back(address);
+        }
+        BankRouter router(shards);
+        if (shards.empty() || !router.listen(stoi(argv[2]))) {
+            return 1;
+        }
+        cout << "Routing port " << argv[2] << " to " << shards.size() << " shards" << endl;
+        router.run();
+        router.printStats(cout);
+        return 0;
+    }
     BankSystem bank;
-    menu(bank);
+    string journalPath;
+    string snapshotPath;
+    string metricsPath;
+    string archivePath;
+    int servePort = 0;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string option = argv[i];
+        if (option == "--event-log") {
+            unique_ptr<BinaryFileSink> sink(new BinaryFileSink(argv[i + 1]));
+            if (!sink->isOpen()) {
+                cout << "Error: Cannot open event log " << argv[i + 1] << endl;
+                return 1;
+            }
+            bank.events().addSink(move(sink));
+        } else if (option == "--journal") {
+            journalPath = argv[i + 1];
+        } else if (option == "--snapshot") {
+            snapshotPath = argv[i + 1];
+        } else if (option == "--metrics") {
+            metricsPath = argv[i + 1];
+        } else if (option == "--archive") {
+            archivePath = argv[i + 1];
+        } else if (option == "--serve") {
+            servePort = stoi(argv[i + 1]);
+        } else {
+            cout << "Unknown option: " << option << endl;
+            return 1;
+        }
+    }
+    if (!archivePath.empty() && !bank.openArchive(archivePath)) { // Archived processes are not loaded again
+        cout << "Error: Cannot open archive " << archivePath << endl;
+        return 1;
+    }
+    if (!snapshotPath.empty()) { // Load before replaying the journal tail
+        bank.loadSnapshot(snapshotPath);
+    }
+    if (!journalPath.empty() && !bank.openJournal(journalPath)) {
+        cout << "Error: Cannot open journal " << journalPath << endl;
+        return 1;
+    }
+    if (!snapshotPath.empty()) {
+        bank.startSnapshots(snapshotPath);
+    }
+    if (!archivePath.empty()) {
+        bank.startArchiving();
+    }
+    if (servePort > 0) {
+        BankServer server(bank);
+        if (!server.listen(servePort)) {
+            return 1;
+        }
+        cout << "Serving on port " << servePort << endl;
+        server.run();
+    } else {
+        menu(bank);
+    }
+    if (!metricsPath.empty() && !bank.stats().dump(metricsPath)) {
+        cout << "Error: Cannot write metrics to " << metricsPath << endl;
+        return 1;
+    }
     return 0;
 }
 